@@ -0,0 +1,487 @@
+/**
+ * @file bench.cpp - Benchmark suite for the heap storage engine.
+ *
+ * Usage: ./bench [--ops N] [--rows N,N,...] [--widths N,N,...] [--repeat N] [--env DIR] [--json FILE]
+ *
+ *      Microbenchmarks time SlottedPage add/get/put/del/ids, HeapTable marshal/unmarshal and
+        HeapFile get/put, --ops operations each. Macrobenchmarks bulk insert, fully scan and
+        project random rows of a table (id INT, payload TEXT) for each combination of --rows and
+        --widths (payload bytes). Every benchmark runs --repeat times and the median is reported;
+        inputs come from a fixed seed, so runs of different builds do the same work. Results are
+        printed and written as JSON to --json (default bench.json) to diff between builds.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <sys/stat.h>
+#include "heap_storage.h"
+
+DbEnv *_DB_ENV;
+
+static const u_int32_t SEED = 4300;
+
+/**
+ * @class Timing - how many operations a benchmark ran and how long they took
+ */
+struct Timing {
+    u_int64_t ops;
+    double seconds;
+};
+
+/**
+ * @class Result - a benchmark's median timing, with the parameters it ran with
+ */
+struct Result {
+    std::string name;
+    std::vector<std::pair<std::string, u_int64_t>> params;
+    Timing timing;
+};
+
+/**
+ * @class Stopwatch - accumulates the time between start() and stop() calls
+ */
+class Stopwatch {
+public:
+    Stopwatch() : seconds(0), begin() {}
+
+    void start() { begin = std::chrono::steady_clock::now(); }
+
+    void stop() { seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); }
+
+    double seconds;
+
+protected:
+    std::chrono::steady_clock::time_point begin;
+};
+
+/**
+ * @class BenchTable - a HeapTable whose marshal and unmarshal the benchmarks can call
+ */
+class BenchTable : public HeapTable {
+public:
+    BenchTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes)
+            : HeapTable(table_name, column_names, column_attributes) {}
+
+    using HeapTable::marshal;
+    using HeapTable::unmarshal;
+};
+
+/**
+ * Time SlottedPage::add, starting a new page whenever one fills up
+ * @param record_size size of each record
+ * @param n_ops number of adds
+ */
+Timing bench_page_add(uint record_size, u_int64_t n_ops) {
+    char blank_space[DbBlock::BLOCK_SZ];
+    Dbt block_dbt(blank_space, sizeof(blank_space));
+    char bytes[DbBlock::BLOCK_SZ];
+    std::memset(bytes, 'x', sizeof(bytes));
+    Dbt rec(bytes, record_size);
+    Stopwatch watch;
+    watch.start();
+    SlottedPage *page = new SlottedPage(block_dbt, 1, true);
+    for (u_int64_t i = 0; i < n_ops; i++) {
+        if (page->free_space() < record_size + 4) {
+            delete page;
+            page = new SlottedPage(block_dbt, 1, true);
+        }
+        page->add(&rec);
+    }
+    watch.stop();
+    delete page;
+    return Timing{n_ops, watch.seconds};
+}
+
+/**
+ * Fill a page with records of one size
+ * @return the number of records it took
+ */
+static uint fill_page(SlottedPage &page, uint record_size, char *bytes) {
+    Dbt rec(bytes, record_size);
+    uint n = 0;
+    while (page.free_space() >= record_size + 4) {
+        page.add(&rec);
+        n++;
+    }
+    return n;
+}
+
+/**
+ * Time SlottedPage::get of random records of a full page
+ * @param record_size size of each record
+ * @param n_ops number of gets
+ */
+Timing bench_page_get(uint record_size, u_int64_t n_ops) {
+    char blank_space[DbBlock::BLOCK_SZ];
+    Dbt block_dbt(blank_space, sizeof(blank_space));
+    SlottedPage page(block_dbt, 1, true);
+    char bytes[DbBlock::BLOCK_SZ];
+    std::memset(bytes, 'x', sizeof(bytes));
+    uint n_records = fill_page(page, record_size, bytes);
+    std::mt19937 random(SEED);
+    Stopwatch watch;
+    watch.start();
+    for (u_int64_t i = 0; i < n_ops; i++)
+        delete page.get((RecordID) (random() % n_records + 1));
+    watch.stop();
+    return Timing{n_ops, watch.seconds};
+}
+
+/**
+ * Time SlottedPage::put of random records of a full page
+ * @param record_size size of each record
+ * @param n_ops number of puts
+ * @param resize if true, alternate between shrinking and growing records by a quarter
+ */
+Timing bench_page_put(uint record_size, u_int64_t n_ops, bool resize) {
+    char blank_space[DbBlock::BLOCK_SZ];
+    Dbt block_dbt(blank_space, sizeof(blank_space));
+    SlottedPage page(block_dbt, 1, true);
+    char bytes[DbBlock::BLOCK_SZ];
+    std::memset(bytes, 'x', sizeof(bytes));
+    uint n_records = fill_page(page, record_size, bytes);
+
+    uint small_size = record_size - record_size / 4;
+    std::mt19937 random(SEED);
+    Stopwatch watch;
+    watch.start();
+    for (u_int64_t i = 0; i < n_ops; i++) {
+        RecordID id = (RecordID) (random() % n_records + 1);
+        Dbt data(bytes, resize && i % 2 == 0 ? small_size : record_size);
+        page.put(id, data);
+    }
+    watch.stop();
+    return Timing{n_ops, watch.seconds};
+}
+
+/**
+ * Time SlottedPage::del of every record of full pages, in random order (filling the pages is not timed)
+ * @param record_size size of each record
+ * @param n_ops number of dels (at least)
+ */
+Timing bench_page_del(uint record_size, u_int64_t n_ops) {
+    char blank_space[DbBlock::BLOCK_SZ];
+    Dbt block_dbt(blank_space, sizeof(blank_space));
+    char bytes[DbBlock::BLOCK_SZ];
+    std::memset(bytes, 'x', sizeof(bytes));
+    std::mt19937 random(SEED);
+    Stopwatch watch;
+    u_int64_t done = 0;
+    while (done < n_ops) {
+        SlottedPage page(block_dbt, 1, true);
+        uint n_records = fill_page(page, record_size, bytes);
+        std::vector<RecordID> ids;
+        for (RecordID id = 1; id <= n_records; id++)
+            ids.push_back(id);
+        std::shuffle(ids.begin(), ids.end(), random);
+        watch.start();
+        for (RecordID id : ids)
+            page.del(id);
+        watch.stop();
+        done += n_records;
+    }
+    return Timing{done, watch.seconds};
+}
+
+/**
+ * Time SlottedPage::ids of a full page
+ * @param record_size size of each record
+ * @param n_ops number of calls
+ */
+Timing bench_page_ids(uint record_size, u_int64_t n_ops) {
+    char blank_space[DbBlock::BLOCK_SZ];
+    Dbt block_dbt(blank_space, sizeof(blank_space));
+    SlottedPage page(block_dbt, 1, true);
+    char bytes[DbBlock::BLOCK_SZ];
+    std::memset(bytes, 'x', sizeof(bytes));
+    fill_page(page, record_size, bytes);
+    Stopwatch watch;
+    watch.start();
+    for (u_int64_t i = 0; i < n_ops; i++)
+        delete page.ids();
+    watch.stop();
+    return Timing{n_ops, watch.seconds};
+}
+
+static ColumnNames bench_column_names() {
+    ColumnNames column_names;
+    column_names.push_back("id");
+    column_names.push_back("payload");
+    return column_names;
+}
+
+static ColumnAttributes bench_column_attributes() {
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    return column_attributes;
+}
+
+/**
+ * Time HeapTable::marshal or unmarshal of a row (id INT, payload TEXT)
+ * @param width payload bytes
+ * @param n_ops number of rows
+ * @param unmarshal time unmarshal of a marshaled row instead of marshal
+ */
+Timing bench_marshal(uint width, u_int64_t n_ops, bool unmarshal) {
+    BenchTable table("_bench_marshal", bench_column_names(), bench_column_attributes());
+    ValueDict row;
+    row["id"] = Value(4300);
+    row["payload"] = Value(std::string(width, 'x'));
+    Stopwatch watch;
+    if (unmarshal) {
+        Dbt *data = table.marshal(&row);
+        watch.start();
+        for (u_int64_t i = 0; i < n_ops; i++)
+            delete table.unmarshal(data);
+        watch.stop();
+        delete[] (char *) data->get_data();
+        delete data;
+    } else {
+        watch.start();
+        for (u_int64_t i = 0; i < n_ops; i++) {
+            Dbt *data = table.marshal(&row);
+            delete[] (char *) data->get_data();
+            delete data;
+        }
+        watch.stop();
+    }
+    return Timing{n_ops, watch.seconds};
+}
+
+/**
+ * Time HeapFile::get or put of random blocks of a file
+ * @param n_blocks blocks in the file
+ * @param n_ops number of gets or puts
+ * @param put time put (of a block just read, which is not timed) instead of get
+ */
+Timing bench_file(uint n_blocks, u_int64_t n_ops, bool put) {
+    HeapFile file("_bench_file");
+    file.create();
+    char buffer[DbBlock::BLOCK_SZ];
+    while (file.get_last_block_id() < n_blocks)
+        file.allocate(buffer);
+    std::mt19937 random(SEED);
+    Stopwatch watch;
+    if (put) {
+        for (u_int64_t i = 0; i < n_ops; i++) {
+            SlottedPage *block = file.get((BlockID) (random() % n_blocks + 1));
+            watch.start();
+            file.put(block);
+            watch.stop();
+            delete block;
+        }
+    } else {
+        watch.start();
+        for (u_int64_t i = 0; i < n_ops; i++)
+            delete file.get((BlockID) (random() % n_blocks + 1));
+        watch.stop();
+    }
+    file.drop();
+    return Timing{n_ops, watch.seconds};
+}
+
+/**
+ * Bulk insert rows (id INT, payload TEXT) into a new table, then fully scan it, then project random rows
+ * @param n_rows rows to insert
+ * @param width payload bytes
+ * @param n_projects rows to project
+ * @return the timings of the insert, the scan and the projects
+ */
+std::vector<Timing> bench_table(u_int64_t n_rows, uint width, u_int64_t n_projects) {
+    const u_int64_t BATCH = 10000;
+    HeapTable table("_bench_table", bench_column_names(), bench_column_attributes());
+    table.create();
+    std::string payload(width, 'x');
+    Handles handles;
+    Rows rows;
+    Stopwatch insert;
+    for (u_int64_t first = 0; first < n_rows; first += BATCH) {
+        u_int64_t n = std::min(BATCH, n_rows - first);
+        rows.assign(n, Row(&table.get_column_names()));
+        for (u_int64_t i = 0; i < n; i++) {
+            rows[i].set(0, (int32_t) (first + i));
+            rows[i].set(1, payload);
+        }
+        insert.start();
+        Handles *batch = table.insert_batch(rows);
+        insert.stop();
+        handles.insert(handles.end(), batch->begin(), batch->end());
+        delete batch;
+    }
+    insert.start();
+    table.get_buffer_pool().flush();
+    insert.stop();
+
+    Stopwatch scan;
+    u_int64_t n_scanned = 0;
+    Row row(&table.get_column_names());
+    scan.start();
+    HeapTableIterator *it = table.scan();
+    while (it->next()) {
+        it->get_row(row);
+        n_scanned++;
+    }
+    delete it;
+    scan.stop();
+
+    std::mt19937 random(SEED);
+    Stopwatch project;
+    project.start();
+    for (u_int64_t i = 0; i < n_projects && !handles.empty(); i++)
+        table.project(handles[random() % handles.size()], row);
+    project.stop();
+
+    table.drop();
+    std::vector<Timing> timings;
+    timings.push_back(Timing{n_rows, insert.seconds});
+    timings.push_back(Timing{n_scanned, scan.seconds});
+    timings.push_back(Timing{handles.empty() ? 0 : n_projects, project.seconds});
+    return timings;
+}
+
+/**
+ * The median timing of some runs
+ * @param runs the runs (reordered)
+ */
+static Timing median(std::vector<Timing> &runs) {
+    std::sort(runs.begin(), runs.end(), [](const Timing &a, const Timing &b) { return a.seconds < b.seconds; });
+    return runs[runs.size() / 2];
+}
+
+/**
+ * Parse a comma-separated list of numbers
+ */
+static std::vector<u_int64_t> parse_list(const std::string &list) {
+    std::vector<u_int64_t> numbers;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        numbers.push_back(std::strtoull(item.c_str(), nullptr, 10));
+    return numbers;
+}
+
+/**
+ * Print a result as a line of a table
+ */
+static void print(const Result &result) {
+    std::string params;
+    for (const auto &param : result.params)
+        params += " " + param.first + "=" + std::to_string(param.second);
+    double ns_per_op = result.timing.ops == 0 ? 0 : result.timing.seconds * 1e9 / result.timing.ops;
+    std::cout << result.name << params << ": " << result.timing.ops << " ops in " << result.timing.seconds
+              << " s, " << ns_per_op << " ns/op" << std::endl;
+}
+
+/**
+ * Write the results as JSON: {"seed": ..., "repeat": ..., "results": [{"name", "params", "ops", "seconds",
+ * "ops_per_sec", "ns_per_op"}, ...]}
+ */
+static void write_json(std::ostream &out, const std::vector<Result> &results, uint repeat) {
+    out << "{\n  \"suite\": \"storage\",\n  \"seed\": " << SEED << ",\n  \"repeat\": " << repeat
+        << ",\n  \"block_size\": " << DbBlock::BLOCK_SZ << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &result = results[i];
+        out << "    {\"name\": \"" << result.name << "\", \"params\": {";
+        for (size_t p = 0; p < result.params.size(); p++)
+            out << (p == 0 ? "" : ", ") << "\"" << result.params[p].first << "\": " << result.params[p].second;
+        double seconds = result.timing.seconds;
+        out << "}, \"ops\": " << result.timing.ops << ", \"seconds\": " << seconds
+            << ", \"ops_per_sec\": " << (seconds > 0 ? result.timing.ops / seconds : 0)
+            << ", \"ns_per_op\": " << (result.timing.ops > 0 ? seconds * 1e9 / result.timing.ops : 0) << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char *argv[]) {
+    u_int64_t n_ops = 1000000;
+    std::vector<u_int64_t> row_counts = {10000, 100000};
+    std::vector<u_int64_t> widths = {16, 128, 1024};
+    uint repeat = 3;
+    std::string env_dir = "bench_env";
+    std::string json_path = "bench.json";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i], value = argv[i + 1];
+        if (option == "--ops")
+            n_ops = std::strtoull(value.c_str(), nullptr, 10);
+        else if (option == "--rows")
+            row_counts = parse_list(value);
+        else if (option == "--widths")
+            widths = parse_list(value);
+        else if (option == "--repeat")
+            repeat = (uint) std::max(1, std::atoi(value.c_str()));
+        else if (option == "--env")
+            env_dir = value;
+        else if (option == "--json")
+            json_path = value;
+        else {
+            std::cerr << "Usage: ./bench [--ops N] [--rows N,N,...] [--widths N,N,...] [--repeat N] [--env DIR] "
+                         "[--json FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    mkdir(env_dir.c_str(), 0755);
+    DbEnv env(0U);
+    env.set_message_stream(&std::cout);
+    env.set_error_stream(&std::cerr);
+    env.open(env_dir.c_str(), DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
+    _DB_ENV = &env;
+
+    std::vector<Result> results;
+    auto run = [&](const std::string &name, std::vector<std::pair<std::string, u_int64_t>> params,
+                   std::function<Timing()> benchmark) {
+        std::vector<Timing> runs;
+        for (uint r = 0; r < repeat; r++)
+            runs.push_back(benchmark());
+        results.push_back(Result{name, params, median(runs)});
+        print(results.back());
+    };
+
+    const uint record_size = 16, n_blocks = 1000;
+    u_int64_t file_ops = std::max((u_int64_t) 1, n_ops / 100);
+    run("slotted_page_add", {{"record_size", record_size}}, [&]() { return bench_page_add(record_size, n_ops); });
+    run("slotted_page_get", {{"record_size", record_size}}, [&]() { return bench_page_get(record_size, n_ops); });
+    run("slotted_page_put", {{"record_size", record_size}, {"resize", 0}},
+        [&]() { return bench_page_put(record_size, n_ops, false); });
+    run("slotted_page_put", {{"record_size", record_size}, {"resize", 1}},
+        [&]() { return bench_page_put(record_size, n_ops, true); });
+    run("slotted_page_del", {{"record_size", record_size}}, [&]() { return bench_page_del(record_size, n_ops); });
+    run("slotted_page_ids", {{"record_size", record_size}},
+        [&]() { return bench_page_ids(record_size, std::max((u_int64_t) 1, n_ops / 100)); });
+    for (u_int64_t width : widths) {
+        run("heap_table_marshal", {{"width", width}}, [&]() { return bench_marshal((uint) width, n_ops / 10, false); });
+        run("heap_table_unmarshal", {{"width", width}},
+            [&]() { return bench_marshal((uint) width, n_ops / 10, true); });
+    }
+    run("heap_file_get", {{"blocks", n_blocks}}, [&]() { return bench_file(n_blocks, file_ops, false); });
+    run("heap_file_put", {{"blocks", n_blocks}}, [&]() { return bench_file(n_blocks, file_ops, true); });
+
+    for (u_int64_t n_rows : row_counts) {
+        for (u_int64_t width : widths) {
+            std::vector<std::vector<Timing>> runs(3);
+            for (uint r = 0; r < repeat; r++) {
+                std::vector<Timing> timings = bench_table(n_rows, (uint) width, std::min(n_rows, n_ops / 10));
+                for (uint t = 0; t < timings.size(); t++)
+                    runs[t].push_back(timings[t]);
+            }
+            const char *names[] = {"bulk_insert", "full_scan", "point_project"};
+            for (uint t = 0; t < runs.size(); t++) {
+                results.push_back(Result{names[t], {{"rows", n_rows}, {"width", width}}, median(runs[t])});
+                print(results.back());
+            }
+        }
+    }
+
+    std::ofstream out(json_path);
+    write_json(out, results, repeat);
+    std::cout << "wrote " << json_path << std::endl;
+    return 0;
+}
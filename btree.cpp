@@ -0,0 +1,488 @@
+#include "btree.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+/**
+ * @class BTreeIndex
+ *
+ * B+tree over an INT column, with nodes kept in the index's own HeapFile.
+ */
+
+/**
+ * Set up an index (use create() or open() before using it)
+ * @param relation the indexed table
+ * @param name the index's name (its file is named after the table and the index)
+ * @param key_columns the key column, which must be a single INT column of relation
+ * @param unique whether to refuse a second row with the same key
+ * @throws DbRelationError if the key is not a single INT column
+ */
+BTreeIndex::BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique) :
+            DbIndex(relation, name, key_columns, unique), file(relation.get_table_name() + "-" + name),
+            pool(file), key_column(0), root(0), closed(true) {
+    if (key_columns.size() != 1)
+        throw DbRelationError("BTREE index must have exactly one key column");
+    const ColumnNames &column_names = relation.get_column_names();
+    ColumnNames::const_iterator column = std::find(column_names.begin(), column_names.end(), key_columns[0]);
+    if (column == column_names.end())
+        throw DbRelationError("No such column " + key_columns[0]);
+    key_column = (uint) (column - column_names.begin());
+    if (relation.get_column_attributes()[key_column].get_data_type() != ColumnAttribute::INT)
+        throw DbRelationError("BTREE index key must be an INT column");
+}
+
+/**
+ * Create the index file and build the tree from every row in the table
+ * @throws DbRelationError if the index is unique but the table has duplicate keys
+ */
+void BTreeIndex::create() {
+    file.create(); // block 1, the root pointer, comes with the file
+    closed = false;
+
+    std::vector<BTreeKey> sorted;
+    DbRelationIterator *rows = relation.scan();
+    while (rows->next()) {
+        Handle handle = rows->get_handle();
+        BTreeKey key = {rows->get_row_view()[key_column].n, handle.first, handle.second};
+        sorted.push_back(key);
+    }
+    delete rows;
+    std::sort(sorted.begin(), sorted.end());
+    if (unique) {
+        for (size_t i = 1; i < sorted.size(); i++)
+            if (sorted[i].value == sorted[i - 1].value) {
+                drop();
+                throw DbRelationError("Duplicate key " + std::to_string(sorted[i].value) + " in unique index");
+            }
+    }
+    build(sorted);
+}
+
+/**
+ * Remove the index file
+ */
+void BTreeIndex::drop() {
+    pool.discard();
+    file.drop();
+    closed = true;
+}
+
+/**
+ * Open the index file and find the root
+ */
+void BTreeIndex::open() {
+    if (!closed)
+        return;
+    file.open();
+    closed = false;
+    SlottedPage *meta = pool.pin(1);
+    root = *(BlockID *) meta->get_data();
+    pool.unpin(meta);
+}
+
+/**
+ * Write back any changed nodes and close the index file
+ */
+void BTreeIndex::close() {
+    if (closed)
+        return;
+    pool.flush();
+    pool.discard();
+    file.close();
+    closed = true;
+}
+
+/**
+ * Find the rows with a given key, in handle order
+ * @param key_values dictionary holding the key column's value
+ * @return handles of the matching rows (freed by caller)
+ */
+Handles *BTreeIndex::lookup(const ValueDict *key_values) {
+    open();
+    int32_t value = key_value(key_values);
+    Handles *handles = new Handles();
+    collect(BTreeKey{value, 0, 0}, value, handles);
+    return handles;
+}
+
+/**
+ * Find the rows with keys from min_key through max_key, in key order
+ * @param min_key dictionary holding the lowest key, or nullptr for no lower bound
+ * @param max_key dictionary holding the highest key, or nullptr for no upper bound
+ * @return handles of the matching rows (freed by caller)
+ */
+Handles *BTreeIndex::range(const ValueDict *min_key, const ValueDict *max_key) {
+    open();
+    int32_t min = min_key == nullptr ? INT32_MIN : key_value(min_key);
+    int32_t max = max_key == nullptr ? INT32_MAX : key_value(max_key);
+    Handles *handles = new Handles();
+    if (min <= max)
+        collect(BTreeKey{min, 0, 0}, max, handles);
+    return handles;
+}
+
+/**
+ * Add a row, splitting nodes up the tree as they fill
+ * @param handle the row's handle
+ * @param row the row's values, in the table's column order
+ * @throws DbRelationError if the index is unique and the key is already there
+ */
+void BTreeIndex::insert(Handle handle, const Row &row) {
+    open();
+    BTreeKey key = {row.get_int(key_column), handle.first, handle.second};
+    if (unique) {
+        Handles existing;
+        collect(BTreeKey{key.value, 0, 0}, key.value, &existing);
+        if (!existing.empty() && !(existing.size() == 1 && existing[0] == handle))
+            throw DbRelationError("Duplicate key " + std::to_string(key.value) + " in unique index");
+    }
+
+    std::vector<BlockID> path;
+    SlottedPage *leaf = find_leaf(key, &path);
+    Header *h = header(leaf);
+    BTreeKey *leaf_keys = keys(leaf);
+    uint pos = (uint) (std::lower_bound(leaf_keys, leaf_keys + h->size, key) - leaf_keys);
+    if (pos < h->size && leaf_keys[pos] == key) { // already indexed
+        pool.unpin(leaf);
+        return;
+    }
+    if (h->size < LEAF_CAPACITY) {
+        memmove(leaf_keys + pos + 1, leaf_keys + pos, (h->size - pos) * sizeof(BTreeKey));
+        leaf_keys[pos] = key;
+        h->size++;
+        pool.unpin(leaf, true);
+        return;
+    }
+
+    // split: the lower half stays, the upper half moves to a new leaf to the right
+    BTreeKey all[LEAF_CAPACITY + 1];
+    memcpy(all, leaf_keys, pos * sizeof(BTreeKey));
+    all[pos] = key;
+    memcpy(all + pos + 1, leaf_keys + pos, (h->size - pos) * sizeof(BTreeKey));
+    uint n = h->size + 1;
+    uint left_size = n / 2;
+    SlottedPage *right = pool.pin_new();
+    Header *right_h = header(right);
+    right_h->is_leaf = 1;
+    right_h->size = (u_int16_t) (n - left_size);
+    right_h->link = h->link;
+    memcpy(keys(right), all + left_size, right_h->size * sizeof(BTreeKey));
+    h->size = (u_int16_t) left_size;
+    h->link = right->get_block_id();
+    memcpy(leaf_keys, all, left_size * sizeof(BTreeKey));
+    Entry entry = {all[left_size], right->get_block_id()};
+    pool.unpin(right, true);
+    pool.unpin(leaf, true);
+    insert_entry(path, entry);
+}
+
+/**
+ * Remove a row's entry, if it is there (nodes are never merged)
+ * @param handle the row's handle
+ * @param row the row's values when it was indexed, in the table's column order
+ */
+void BTreeIndex::del(Handle handle, const Row &row) {
+    open();
+    BTreeKey key = {row.get_int(key_column), handle.first, handle.second};
+    SlottedPage *leaf = find_leaf(key, nullptr);
+    Header *h = header(leaf);
+    BTreeKey *leaf_keys = keys(leaf);
+    uint pos = (uint) (std::lower_bound(leaf_keys, leaf_keys + h->size, key) - leaf_keys);
+    if (pos == h->size || !(leaf_keys[pos] == key)) {
+        pool.unpin(leaf);
+        return;
+    }
+    memmove(leaf_keys + pos, leaf_keys + pos + 1, (h->size - pos - 1) * sizeof(BTreeKey));
+    h->size--;
+    pool.unpin(leaf, true);
+}
+
+/**
+ * Re-index a row only if its key changed
+ * @param handle the row's handle
+ * @param old_row the row's values when it was indexed
+ * @param new_row the row's values now
+ */
+void BTreeIndex::update(Handle handle, const Row &old_row, const Row &new_row) {
+    if (old_row.get_int(key_column) != new_row.get_int(key_column))
+        DbIndex::update(handle, old_row, new_row);
+}
+
+/**
+ * Count the levels of the tree
+ * @return 1 for a tree that is just a root leaf
+ */
+uint BTreeIndex::get_height() {
+    open();
+    uint height = 1;
+    SlottedPage *node = pool.pin(root);
+    while (!header(node)->is_leaf) {
+        BlockID child = header(node)->link;
+        pool.unpin(node);
+        node = pool.pin(child);
+        height++;
+    }
+    pool.unpin(node);
+    return height;
+}
+
+/**
+ * Get the key column's value out of a key dictionary
+ * @param key_values dictionary holding the key column's value
+ * @return the value
+ * @throws DbRelationError if it is missing or not an INT
+ */
+int32_t BTreeIndex::key_value(const ValueDict *key_values) const {
+    ValueDict::const_iterator entry = key_values->find(key_columns[0]);
+    if (entry == key_values->end() || entry->second.data_type != ColumnAttribute::INT)
+        throw DbRelationError("BTREE index lookup needs an INT value for " + key_columns[0]);
+    return entry->second.n;
+}
+
+/**
+ * Build the tree bottom-up from sorted keys: pack the leaves, then each level of interior nodes
+ * above them, until one node is left to be the root
+ * @param sorted every entry, in order
+ */
+void BTreeIndex::build(const std::vector<BTreeKey> &sorted) {
+    const uint leaf_fill = LEAF_CAPACITY * 9 / 10;
+    const uint fanout = INTERIOR_CAPACITY * 9 / 10 + 1; // children per interior node
+    std::vector<Entry> level;  // first key and block of each node in the level being built
+
+    SlottedPage *prev = nullptr;
+    size_t i = 0;
+    do {
+        SlottedPage *leaf = pool.pin_new();
+        uint n = (uint) std::min((size_t) leaf_fill, sorted.size() - i);
+        Header *h = header(leaf);
+        h->is_leaf = 1;
+        h->size = (u_int16_t) n;
+        h->link = 0;
+        if (n > 0)
+            memcpy(keys(leaf), &sorted[i], n * sizeof(BTreeKey));
+        if (prev != nullptr) {
+            header(prev)->link = leaf->get_block_id();
+            pool.unpin(prev, true);
+        }
+        Entry entry = {n > 0 ? sorted[i] : BTreeKey{0, 0, 0}, leaf->get_block_id()};
+        level.push_back(entry);
+        i += n;
+        prev = leaf;
+    } while (i < sorted.size());
+    pool.unpin(prev, true);
+
+    while (level.size() > 1) {
+        std::vector<Entry> parents;
+        for (size_t first = 0; first < level.size(); first += fanout) {
+            uint n = (uint) std::min((size_t) fanout, level.size() - first);
+            SlottedPage *node = pool.pin_new();
+            Header *h = header(node);
+            h->is_leaf = 0;
+            h->size = (u_int16_t) (n - 1);
+            h->link = level[first].child;
+            memcpy(entries(node), &level[first + 1], (n - 1) * sizeof(Entry));
+            Entry entry = {level[first].key, node->get_block_id()};
+            parents.push_back(entry);
+            pool.unpin(node, true);
+        }
+        level.swap(parents);
+    }
+    set_root(level[0].child);
+}
+
+/**
+ * Walk down from the root to the leaf where a key belongs
+ * @param key the key to look for
+ * @param path if not nullptr, filled in with the interior nodes passed through, root first
+ * @return the leaf, pinned (the caller unpins it)
+ */
+SlottedPage *BTreeIndex::find_leaf(const BTreeKey &key, std::vector<BlockID> *path) {
+    SlottedPage *node = pool.pin(root);
+    while (!header(node)->is_leaf) {
+        if (path != nullptr)
+            path->push_back(node->get_block_id());
+        Header *h = header(node);
+        Entry *node_entries = entries(node);
+        // the child after the last separator <= key
+        uint lo = 0;
+        uint hi = h->size;
+        while (lo < hi) {
+            uint mid = (lo + hi) / 2;
+            if (key < node_entries[mid].key)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        BlockID child = lo == 0 ? h->link : node_entries[lo - 1].child;
+        pool.unpin(node);
+        node = pool.pin(child);
+    }
+    return node;
+}
+
+/**
+ * Add the handles of every entry from a key up to a value, following the leaf links
+ * @param from the first key to consider
+ * @param max the last value to include
+ * @param handles where to put the handles
+ */
+void BTreeIndex::collect(BTreeKey from, int32_t max, Handles *handles) {
+    SlottedPage *leaf = find_leaf(from, nullptr);
+    Header *h = header(leaf);
+    BTreeKey *leaf_keys = keys(leaf);
+    uint pos = (uint) (std::lower_bound(leaf_keys, leaf_keys + h->size, from) - leaf_keys);
+    while (true) {
+        for (; pos < h->size; pos++) {
+            if (leaf_keys[pos].value > max) {
+                pool.unpin(leaf);
+                return;
+            }
+            handles->push_back(Handle(leaf_keys[pos].block_id, leaf_keys[pos].record_id));
+        }
+        BlockID next = h->link;
+        pool.unpin(leaf);
+        if (next == 0)
+            return;
+        leaf = pool.pin(next);
+        h = header(leaf);
+        leaf_keys = keys(leaf);
+        pos = 0;
+    }
+}
+
+/**
+ * Add a separator for a new node to its parent, splitting interior nodes (and growing a new root)
+ * as needed
+ * @param path the interior nodes from the root down to the new node's parent (used up as it goes)
+ * @param entry the new node's first key and block id
+ */
+void BTreeIndex::insert_entry(std::vector<BlockID> &path, Entry entry) {
+    while (!path.empty()) {
+        SlottedPage *node = pool.pin(path.back());
+        path.pop_back();
+        Header *h = header(node);
+        Entry *node_entries = entries(node);
+        uint pos = 0;
+        while (pos < h->size && node_entries[pos].key < entry.key)
+            pos++;
+        if (h->size < INTERIOR_CAPACITY) {
+            memmove(node_entries + pos + 1, node_entries + pos, (h->size - pos) * sizeof(Entry));
+            node_entries[pos] = entry;
+            h->size++;
+            pool.unpin(node, true);
+            return;
+        }
+
+        // split: the middle separator moves up, and its child becomes the new node's leftmost child
+        Entry all[INTERIOR_CAPACITY + 1];
+        memcpy(all, node_entries, pos * sizeof(Entry));
+        all[pos] = entry;
+        memcpy(all + pos + 1, node_entries + pos, (h->size - pos) * sizeof(Entry));
+        uint n = h->size + 1;
+        uint mid = n / 2;
+        SlottedPage *right = pool.pin_new();
+        Header *right_h = header(right);
+        right_h->is_leaf = 0;
+        right_h->size = (u_int16_t) (n - mid - 1);
+        right_h->link = all[mid].child;
+        memcpy(entries(right), all + mid + 1, right_h->size * sizeof(Entry));
+        h->size = (u_int16_t) mid;
+        memcpy(node_entries, all, mid * sizeof(Entry));
+        entry = Entry{all[mid].key, right->get_block_id()};
+        pool.unpin(right, true);
+        pool.unpin(node, true);
+    }
+
+    // the root split
+    SlottedPage *new_root = pool.pin_new();
+    Header *h = header(new_root);
+    h->is_leaf = 0;
+    h->size = 1;
+    h->link = root;
+    entries(new_root)[0] = entry;
+    BlockID block_id = new_root->get_block_id();
+    pool.unpin(new_root, true);
+    set_root(block_id);
+}
+
+/**
+ * Record a new root in block 1
+ * @param block_id the root's block
+ */
+void BTreeIndex::set_root(BlockID block_id) {
+    root = block_id;
+    SlottedPage *meta = pool.pin(1);
+    *(BlockID *) meta->get_data() = root;
+    pool.unpin(meta, true);
+}
+
+bool test_btree() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_btree_cpp", column_names, column_attributes);
+    table.create();
+
+    // enough rows, with duplicate keys, that inserts after the build split nodes
+    Rows rows(50000, Row(&table.get_column_names()));
+    for (uint i = 0; i < rows.size(); i++) {
+        rows[i].set(0, (int32_t) ((i * 7919) % 10000));
+        rows[i].set(1, "b");
+    }
+    delete table.insert_batch(rows);
+    ColumnNames key(1, "a");
+    BTreeIndex index(table, "ix", key);
+    index.create();
+    table.add_index(&index);
+    delete table.insert_batch(rows);
+
+    bool ok = index.get_height() >= 2;
+    ValueDict where;
+    where["a"] = Value(1234);
+    Handles *handles = table.select(&where);
+    ok = ok && handles->size() == 10;
+    Row row(&table.get_column_names());
+    for (Handle handle : *handles) {
+        table.project(handle, row);
+        ok = ok && row.get_int(0) == 1234;
+    }
+    delete handles;
+
+    Predicates range;
+    range.push_back(Predicate("a", Predicate::GE, Value(10)));
+    range.push_back(Predicate("a", Predicate::LT, Value(20)));
+    handles = table.select(range);
+    ok = ok && handles->size() == 100;
+    delete handles;
+
+    // an update moves the row's entry
+    where["a"] = Value(5);
+    handles = table.select(&where);
+    Handle moved = (*handles)[0];
+    delete handles;
+    ValueDict change;
+    change["a"] = Value(-1);
+    table.update(moved, &change);
+    where["a"] = Value(-1);
+    handles = index.lookup(&where);
+    ok = ok && handles->size() == 1 && (*handles)[0] == moved;
+    delete handles;
+
+    index.close();
+    index.open();
+    ValueDict low;
+    low["a"] = Value(9998);
+    handles = index.range(&low, nullptr);
+    ok = ok && handles->size() == 20;
+    delete handles;
+    if (!ok)
+        std::cout << "btree index did not find the right rows" << std::endl;
+
+    table.remove_index(&index);
+    index.drop();
+    table.drop();
+    return ok;
+}
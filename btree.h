@@ -0,0 +1,129 @@
+/**
+ * @file btree.h - B+tree index on an INT column.
+ * BTreeKey
+ * BTreeIndex
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <vector>
+#include "heap_storage.h"
+
+/**
+ * @class BTreeKey - one index entry: a key value and the handle of its row
+ *
+ * Entries are ordered by value and then by handle, so every entry is distinct even when many rows
+ * share a value, and a row's entry can always be found again to delete it.
+ */
+struct BTreeKey {
+    int32_t value;
+    BlockID block_id;
+    RecordID record_id;
+
+    bool operator<(const BTreeKey &other) const {
+        if (value != other.value)
+            return value < other.value;
+        if (block_id != other.block_id)
+            return block_id < other.block_id;
+        return record_id < other.record_id;
+    }
+
+    bool operator==(const BTreeKey &other) const {
+        return value == other.value && block_id == other.block_id && record_id == other.record_id;
+    }
+};
+
+/**
+ * @class BTreeIndex - disk-based B+tree mapping the values of one INT column to handles
+ *
+ *      Nodes are whole blocks of a HeapFile of their own, cached in a BufferPool like the heap's
+        blocks. They are not slotted pages: every entry has the same size, so a node is a header
+        followed by a sorted array that is binary searched. Block 1 holds the root's block id.
+            leaf:     header, then up to LEAF_CAPACITY BTreeKeys; leaves are linked left to right
+            interior: header (whose link is the leftmost child), then up to INTERIOR_CAPACITY
+                      (separator, child) pairs; a child's keys are >= its separator
+        A lookup or the start of a range reads one node per level; a range then follows the leaf
+        links. create() sorts the table's keys and builds the tree bottom-up with nodes 90% full.
+        Deleting never merges nodes, so a node can become empty (searches just skip over it).
+ */
+class BTreeIndex : public DbIndex {
+public:
+    struct Header {
+        u_int16_t is_leaf;
+        u_int16_t size;     // number of keys
+        BlockID link;       // leaf: next leaf (0 if none); interior: leftmost child
+    };
+
+    struct Entry {
+        BTreeKey key;       // separator: the smallest key in child
+        BlockID child;
+    };
+
+    static const uint LEAF_CAPACITY = (DbBlock::BLOCK_SZ - sizeof(Header)) / sizeof(BTreeKey);
+    static const uint INTERIOR_CAPACITY = (DbBlock::BLOCK_SZ - sizeof(Header)) / sizeof(Entry);
+
+    BTreeIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique = false);
+
+    virtual ~BTreeIndex() {}
+
+    BTreeIndex(const BTreeIndex &other) = delete;
+
+    BTreeIndex(BTreeIndex &&temp) = delete;
+
+    BTreeIndex &operator=(const BTreeIndex &other) = delete;
+
+    BTreeIndex &operator=(BTreeIndex &&temp) = delete;
+
+    virtual void create();
+
+    virtual void drop();
+
+    virtual void open();
+
+    virtual void close();
+
+    virtual Handles *lookup(const ValueDict *key_values);
+
+    virtual Handles *range(const ValueDict *min_key, const ValueDict *max_key);
+
+    using DbIndex::insert;
+    using DbIndex::del;
+
+    virtual void insert(Handle handle, const Row &row);
+
+    virtual void del(Handle handle, const Row &row);
+
+    virtual void update(Handle handle, const Row &old_row, const Row &new_row);
+
+    virtual bool supports_range() const { return true; }
+
+    virtual uint get_height();
+
+protected:
+    HeapFile file;
+    BufferPool pool;
+    uint key_column;    // ordinal of the key column in the relation
+    BlockID root;
+    bool closed;
+
+    virtual int32_t key_value(const ValueDict *key_values) const;
+
+    virtual void build(const std::vector<BTreeKey> &keys);
+
+    virtual SlottedPage *find_leaf(const BTreeKey &key, std::vector<BlockID> *path);
+
+    virtual void collect(BTreeKey from, int32_t max, Handles *handles);
+
+    virtual void insert_entry(std::vector<BlockID> &path, Entry entry);
+
+    virtual void set_root(BlockID block_id);
+
+    static Header *header(SlottedPage *node) { return (Header *) node->get_data(); }
+
+    static BTreeKey *keys(SlottedPage *node) { return (BTreeKey *) ((char *) node->get_data() + sizeof(Header)); }
+
+    static Entry *entries(SlottedPage *node) { return (Entry *) ((char *) node->get_data() + sizeof(Header)); }
+};
+
+bool test_btree();
@@ -0,0 +1,377 @@
+#include "buffer_pool.h"
+#include "heap_storage.h"
+#include "wal.h"
+#include <set>
+
+/**
+ * @class BufferPool
+ *
+ * Caches the blocks of a HeapFile in a fixed set of frames with pin/unpin and clock eviction.
+ */
+
+// every pool that exists, for flush_logged() (made on first use, so pools built during static
+// initialization can register too)
+static std::mutex &pools_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::set<BufferPool *> &all_pools() {
+    static std::set<BufferPool *> pools;
+    return pools;
+}
+
+/**
+ * Constructs an empty buffer pool
+ * @param file the heap file whose blocks are cached
+ * @param n_frames number of DbBlock::BLOCK_SZ frames to allocate
+ */
+BufferPool::BufferPool(HeapFile &file, uint n_frames) : file(file), memory((size_t) n_frames * DbBlock::BLOCK_SZ),
+            frames(n_frames), frame_of(), hand(0), hits(0), misses(0), evictions(0), writes(0) {
+    if (n_frames == 0)
+        throw BufferPoolError("buffer pool needs at least one frame");
+    for (auto &frame : frames)
+        frame = Frame{0, nullptr, 0, false, false};
+    std::lock_guard<std::mutex> lock(pools_mutex());
+    all_pools().insert(this);
+}
+
+/**
+ * Frees the frames' pages (dirty frames must already have been flushed)
+ */
+BufferPool::~BufferPool() {
+    {
+        std::lock_guard<std::mutex> lock(pools_mutex());
+        all_pools().erase(this);
+    }
+    for (auto &frame : frames)
+        delete frame.page;
+}
+
+/**
+ * Pin a block, reading it from the file if it is not already in the pool
+ * @param block_id the block to pin
+ * @param exclusive true to latch the block for changing it, false to share it with other readers
+ * @return the block (valid until it is unpinned)
+ * @throws BufferPoolError if every frame is pinned
+ * @throws DbRelationError if there is no such block
+ */
+SlottedPage *BufferPool::pin(BlockID block_id, bool exclusive) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        auto found = frame_of.find(block_id);
+        if (found != frame_of.end()) {
+            Frame &frame = frames[found->second];
+            frame.pin_count++;
+            frame.referenced = true;
+            hits++;
+            SlottedPage *page = frame.page;
+            lock.unlock();
+            if (exclusive)
+                page->get_latch().lock();
+            else
+                page->get_latch().lock_shared();
+            if (page->get_block_id() == block_id)
+                return page;
+            unpin(page); // the thread reading it in could not, so try again (and get its error)
+            lock.lock();
+            continue;
+        }
+
+        uint i = victim(lock);
+        if (frame_of.count(block_id) != 0)
+            continue; // read in by another thread while victim() was writing a block back
+
+        // claim the frame and latch it before letting go of the mutex, so a thread pinning the same
+        // block meanwhile waits for this read instead of reading the block again
+        misses++;
+        SlottedPage *page = load(i, block_id);
+        page->get_latch().lock();
+        lock.unlock();
+        try {
+            file.read(block_id, address(i));
+        } catch (...) {
+            abandon(i);
+            throw;
+        }
+        Dbt block(address(i), DbBlock::BLOCK_SZ);
+        page->reset(block, block_id);
+        if (!exclusive)
+            page->get_latch().downgrade();
+        return page;
+    }
+}
+
+/**
+ * Add a new empty block to the file and pin it
+ * @param exclusive true to latch the block for changing it, false to latch it shared
+ * @return the new block (valid until it is unpinned)
+ * @throws BufferPoolError if every frame is pinned
+ */
+SlottedPage *BufferPool::pin_new(bool exclusive) {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint i = victim(lock);
+    BlockID block_id = file.next_block_id(); // under the mutex, so whoever sees the new id finds its frame
+    SlottedPage *page = load(i, block_id);
+    page->get_latch().lock();
+    lock.unlock();
+    try {
+        file.allocate(address(i), block_id);
+    } catch (...) {
+        abandon(i);
+        throw;
+    }
+    Dbt block(address(i), DbBlock::BLOCK_SZ);
+    page->reset(block, block_id);
+    if (!exclusive)
+        page->get_latch().downgrade();
+    return page;
+}
+
+/**
+ * Release a pinned block and its latch
+ * @param block a block returned by pin or pin_new
+ * @param dirty true if the caller modified the block
+ */
+void BufferPool::unpin(SlottedPage *block, bool dirty) {
+    uint i = frame_of_page(block);
+    if (dirty) {
+        // marked before the image is logged: a checkpoint's flush either sees the mark (and waits on
+        // the latch to write the block) or started before the image was logged (and keeps it)
+        std::lock_guard<std::mutex> lock(mutex);
+        frames[i].dirty = true;
+    }
+    if (dirty && file.is_logged() && _DB_LOG != nullptr) // while the block is still latched, so the image is whole
+        _DB_LOG->log_page(file.get_name(), block->get_block_id(), address(i));
+    std::lock_guard<std::mutex> lock(mutex);
+    Frame &frame = frames[i];
+    if (frame.pin_count == 0)
+        throw BufferPoolError("unpin of a block that is not pinned");
+    frame.pin_count--;
+    block->get_latch().unlock(); // under the mutex, so a frame with no pins is never latched
+}
+
+/**
+ * Write every dirty frame back to the file (frames stay cached)
+ * Each block is pinned while it is written, and other threads can keep using the rest of the pool.
+ */
+void BufferPool::flush(void) {
+    for (uint i = 0; i < frames.size(); i++) {
+        std::unique_lock<std::mutex> lock(mutex);
+        Frame &frame = frames[i];
+        if (frame.block_id == 0 || !frame.dirty)
+            continue;
+        frame.pin_count++;
+        try {
+            write(i, lock);
+        } catch (...) {
+            frame.pin_count--;
+            throw;
+        }
+        frame.pin_count--;
+    }
+}
+
+/**
+ * Write back the dirty frames of every pool on an open, logged file, and sync those files
+ * Used by WriteAheadLog::checkpoint(), so the blocks it logged are in their files before it empties
+ * the log. The pools' tables can go on being used meanwhile, but none may be created, opened or
+ * closed.
+ */
+void BufferPool::flush_logged(void) {
+    std::lock_guard<std::mutex> lock(pools_mutex());
+    for (BufferPool *pool : all_pools()) {
+        if (!pool->file.is_logged() || !pool->file.is_open())
+            continue;
+        pool->flush();
+        pool->file.sync();
+    }
+}
+
+/**
+ * Forget every cached block without writing it, e.g. once the file is closed or dropped
+ */
+void BufferPool::discard(void) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &frame : frames) {
+        frame.block_id = 0;
+        frame.pin_count = 0;
+        frame.dirty = false;
+        frame.referenced = false;
+    }
+    frame_of.clear();
+    hand = 0;
+}
+
+/**
+ * Find a frame to reuse with the clock algorithm, writing the old block back if it is dirty
+ * Called with the mutex held, which is let go while a block is written back (so anything may have
+ * changed by the time this returns). A frame nobody has pinned is not latched, so it can be taken over.
+ * @param lock the caller's hold on the mutex
+ * @return index of a free frame
+ * @throws BufferPoolError if every frame is pinned
+ */
+uint BufferPool::victim(std::unique_lock<std::mutex> &lock) {
+    // two sweeps clear every reference bit, so if nothing turns up by then every frame is pinned
+    for (size_t step = 0; step < 2 * frames.size(); step++) {
+        uint i = hand;
+        hand = (hand + 1) % frames.size();
+        Frame &frame = frames[i];
+        if (frame.pin_count > 0)
+            continue;
+        if (frame.block_id == 0)
+            return i;
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        if (frame.dirty) {
+            frame.pin_count++; // stays cached (and can be pinned) while it is written, but not taken
+            try {
+                write(i, lock);
+            } catch (...) {
+                frame.pin_count--;
+                throw;
+            }
+            frame.pin_count--;
+            if (frame.pin_count > 0 || frame.referenced || frame.dirty)
+                continue; // wanted again meanwhile
+        }
+        frame_of.erase(frame.block_id);
+        frame.block_id = 0;
+        evictions++;
+        return i;
+    }
+    throw BufferPoolError("all buffer pool frames are pinned");
+}
+
+/**
+ * Set up a frame for a block, and pin it (called with the mutex held)
+ * If the block's bytes are not in the frame's memory yet, the page has to be reset once they are.
+ * @param i index of the frame
+ * @param block_id the block now held by the frame
+ * @return the frame's page
+ */
+SlottedPage *BufferPool::load(uint i, BlockID block_id) {
+    Frame &frame = frames[i];
+    Dbt block(address(i), DbBlock::BLOCK_SZ);
+    if (frame.page == nullptr)
+        frame.page = new SlottedPage(block, block_id);
+    else
+        frame.page->reset(block, block_id);
+    frame.block_id = block_id;
+    frame.pin_count = 1;
+    frame.dirty = false;
+    frame.referenced = true;
+    frame_of[block_id] = i;
+    return frame.page;
+}
+
+/**
+ * Write a frame's block back to the file without holding up the rest of the pool
+ * Called with the mutex held and the frame pinned; the mutex is let go during the write and held
+ * again on return. The block is latched shared meanwhile, so nobody changes it half written.
+ * @param i index of the dirty frame
+ * @param lock the caller's hold on the mutex
+ */
+void BufferPool::write(uint i, std::unique_lock<std::mutex> &lock) {
+    Frame &frame = frames[i];
+    SlottedPage *page = frame.page;
+    lock.unlock();
+    page->get_latch().lock_shared();
+    try {
+        file.put(page);
+    } catch (...) {
+        page->get_latch().unlock();
+        lock.lock();
+        throw;
+    }
+    lock.lock();
+    frame.dirty = false; // nobody can have changed it while it was latched
+    writes++;
+    page->get_latch().unlock();
+}
+
+/**
+ * Give up a frame claimed for a block that could not be read or added, and its pin and latch
+ * Called with the frame latched exclusively and the mutex not held.
+ * @param i index of the frame
+ */
+void BufferPool::abandon(uint i) {
+    Frame &frame = frames[i];
+    Dbt block(address(i), DbBlock::BLOCK_SZ);
+    frame.page->reset(block, 0); // how threads waiting on the latch learn the block is not there
+    std::lock_guard<std::mutex> lock(mutex);
+    frame_of.erase(frame.block_id);
+    frame.block_id = 0;
+    frame.dirty = false;
+    frame.pin_count--;
+    frame.page->get_latch().unlock();
+}
+
+/**
+ * Find the frame a pinned page belongs to from where its memory is
+ * @param block a block returned by pin or pin_new
+ * @return index of its frame
+ * @throws BufferPoolError if the block is not one of this pool's
+ */
+uint BufferPool::frame_of_page(SlottedPage *block) {
+    uintptr_t data = (uintptr_t) block->get_data();
+    uintptr_t base = (uintptr_t) memory.data();
+    uint i = (uint) ((data - base) / DbBlock::BLOCK_SZ);
+    if (data < base || data >= base + memory.size() || frames[i].page != block)
+        throw BufferPoolError("unpin of a block that is not pinned");
+    return i;
+}
+
+// test function -- returns true if all tests pass
+bool test_buffer_pool() {
+    HeapFile file("_test_buffer_pool_cpp");
+    file.create(); // starts with block 1
+    bool ok = true;
+    {
+        BufferPool pool(file, 2);
+
+        // fill more blocks than there are frames so that the dirty ones get evicted
+        for (int i = 0; i < 3; i++) {
+            SlottedPage *block = pool.pin_new();
+            char rec[] = "hello";
+            Dbt rec_dbt(rec, sizeof(rec));
+            block->add(&rec_dbt);
+            pool.unpin(block, true);
+        }
+        if (pool.get_evictions() == 0 || pool.get_writes() == 0) {
+            std::cout << "buffer pool did not evict dirty blocks" << std::endl;
+            ok = false;
+        }
+
+        // a block that was written out on eviction comes back with its record
+        SlottedPage *block = pool.pin(2);
+        if (!block->has(1)) {
+            std::cout << "buffer pool lost an evicted block's record" << std::endl;
+            ok = false;
+        }
+        u_int64_t hits = pool.get_hits();
+        SlottedPage *again = pool.pin(2);
+        if (again != block || pool.get_hits() != hits + 1) {
+            std::cout << "buffer pool missed a cached block" << std::endl;
+            ok = false;
+        }
+
+        // with both frames pinned there is nothing to evict
+        SlottedPage *other = pool.pin(3);
+        try {
+            pool.pin(1);
+            std::cout << "buffer pool did not throw when every frame was pinned" << std::endl;
+            ok = false;
+        } catch (BufferPoolError &e) {
+            // expected
+        }
+        pool.unpin(other);
+        pool.unpin(again);
+        pool.unpin(block);
+        pool.flush();
+    }
+    file.drop();
+    return ok;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file buffer_pool.h - Buffer pool sitting between a HeapTable and its HeapFile.
+ * BufferPool
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "storage_engine.h"
+
+class HeapFile;
+class SlottedPage;
+
+/**
+ * @class BufferPoolError - exception for when the pool cannot find a frame
+ */
+class BufferPoolError : public std::runtime_error {
+public:
+    explicit BufferPoolError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class BufferPool - fixed number of DbBlock::BLOCK_SZ frames caching the blocks of one HeapFile
+ *
+ *      A block is pinned while a caller is using it and cannot be evicted until it is unpinned.
+        Unpinning with dirty = true marks the frame to be written back to the file when it is evicted
+        or when the pool is flushed, and (if the file is logged) logs the block's new image to the
+        _DB_LOG. Victims are chosen with the clock algorithm: each frame has a reference bit that is
+        set on every pin and cleared as the clock hand sweeps past it.
+
+        The pool is safe to use from several threads. Pinning also latches the block's page, shared
+        by default or exclusive for a caller that will change it, until it is unpinned, so readers
+        of a block run side by side while a writer has it to itself. The pool's own mutex only
+        guards the frame table: it is never held while waiting for a latch or reading, writing or
+        adding a block (the frame is claimed and latched first, so a thread pinning the same block
+        waits on the latch), so threads working on different blocks only meet there briefly. A
+        block must not be pinned again by a thread that already holds it exclusively.
+
+        Every pool is registered while it exists, so a WriteAheadLog checkpoint can write back the
+        dirty frames of all the pools on logged files, with their tables still open, by calling
+        flush_logged().
+
+        Usage:
+            SlottedPage *block = pool.pin(block_id, true);
+            block->add(data);
+            pool.unpin(block, true);
+ */
+class BufferPool {
+public:
+    /**
+     * default number of frames (256kB of blocks)
+     */
+    static const uint DEFAULT_FRAMES = 64;
+
+    BufferPool(HeapFile &file, uint n_frames = DEFAULT_FRAMES);
+
+    virtual ~BufferPool();
+
+    BufferPool(const BufferPool &other) = delete;
+
+    BufferPool(BufferPool &&temp) = delete;
+
+    BufferPool &operator=(const BufferPool &other) = delete;
+
+    BufferPool &operator=(BufferPool &&temp) = delete;
+
+    virtual SlottedPage *pin(BlockID block_id, bool exclusive = false);
+
+    virtual SlottedPage *pin_new(bool exclusive = false);
+
+    virtual void unpin(SlottedPage *block, bool dirty = false);
+
+    virtual void flush(void);
+
+    virtual void discard(void);
+
+    static void flush_logged(void);
+
+    virtual uint get_size() { return (uint) frames.size(); }
+
+    virtual u_int64_t get_hits() { return hits; }
+
+    virtual u_int64_t get_misses() { return misses; }
+
+    virtual u_int64_t get_evictions() { return evictions; }
+
+    virtual u_int64_t get_writes() { return writes; }
+
+protected:
+    struct Frame {
+        BlockID block_id;   // 0 if the frame is empty
+        SlottedPage *page;  // wraps this frame's memory; allocated once and reset for each block
+        uint pin_count;
+        bool dirty;
+        bool referenced;
+    };
+
+    HeapFile &file;
+    std::mutex mutex;       // guards everything below but the frames' memory (which their pages' latches guard)
+    std::vector<char> memory;
+    std::vector<Frame> frames;
+    std::unordered_map<BlockID, uint> frame_of;
+    uint hand;
+    std::atomic<u_int64_t> hits;        // counted under the mutex, but read without it
+    std::atomic<u_int64_t> misses;
+    std::atomic<u_int64_t> evictions;
+    std::atomic<u_int64_t> writes;
+
+    virtual uint victim(std::unique_lock<std::mutex> &lock);
+
+    virtual SlottedPage *load(uint frame, BlockID block_id);
+
+    virtual void write(uint frame, std::unique_lock<std::mutex> &lock);
+
+    virtual void abandon(uint frame);
+
+    virtual uint frame_of_page(SlottedPage *block);
+
+    virtual void *address(uint frame) { return &memory[(size_t) frame * DbBlock::BLOCK_SZ]; }
+};
+
+bool test_buffer_pool();
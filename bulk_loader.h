@@ -0,0 +1,64 @@
+/**
+ * @file bulk_loader.h - Loads delimited text files straight into a HeapTable's blocks.
+ * BulkLoader
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <istream>
+#include <string>
+#include "heap_storage.h"
+
+/**
+ * @class BulkLoader - streams CSV or TSV lines into new blocks at the end of a HeapTable
+ *
+ *      Each line is parsed straight into a reused Row with the table's column types, so there is no
+        per-row validate() and nothing is allocated once the buffers have grown. Rows are packed into
+        one SlottedPage in memory, and each page is appended to the HeapFile with a single write when
+        it is full. Existing blocks are never read, and their free space is left for later inserts.
+        The table's zone map and indices get the rows of each page once it is written and its block
+        id is known.
+
+        Fields are split on the delimiter. In CSV, a field can be double-quoted to contain the
+        delimiter, with "" for a quote; quoted fields cannot span lines.
+        Loading stops at the first bad line; rows in pages already written stay in the table.
+
+        Usage:
+            BulkLoader loader(table, '\t', false);
+            u_int64_t n = loader.load(in);
+ */
+class BulkLoader {
+public:
+    BulkLoader(HeapTable &table, char delimiter = ',', bool quoted = true);
+
+    virtual ~BulkLoader() {}
+
+    BulkLoader(const BulkLoader &other) = delete;
+
+    BulkLoader(BulkLoader &&temp) = delete;
+
+    BulkLoader &operator=(const BulkLoader &other) = delete;
+
+    BulkLoader &operator=(BulkLoader &&temp) = delete;
+
+    virtual u_int64_t load(std::istream &in, bool header = false);
+
+protected:
+    HeapTable &table;
+    char delimiter;
+    bool quoted;
+    Row row;
+    Row written;        // a row of a written page, being added to the zone map and indices
+    std::string line;
+    std::string field;  // a quoted field with its quotes removed
+    char memory[DbBlock::BLOCK_SZ];
+    Dbt data;
+    SlottedPage page;
+
+    virtual void parse(void);
+
+    virtual void write_page(void);
+};
+
+bool test_bulk_loader();
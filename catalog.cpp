@@ -0,0 +1,294 @@
+#include "catalog.h"
+#include "btree.h"
+#include "hash_index.h"
+#include <algorithm>
+
+/**
+ * @class Catalog
+ *
+ * Keeps the schema in system heap tables and every table and index named there open in memory.
+ */
+
+const Identifier Catalog::TABLES = "_tables";
+const Identifier Catalog::COLUMNS = "_columns";
+const Identifier Catalog::INDICES = "_indices";
+
+Catalog::Catalog(Identifier prefix) : prefix(prefix), tables_table(nullptr), columns_table(nullptr),
+            indices_table(nullptr), tables(), indices() {
+}
+
+Catalog::~Catalog() {
+    close();
+}
+
+/**
+ * Open (creating them the first time) the system tables, then every table and index they list
+ */
+void Catalog::open() {
+    if (tables_table != nullptr)
+        return;
+    tables_table = system_table(prefix + TABLES, {"table_name"}, {ColumnAttribute::TEXT});
+    columns_table = system_table(prefix + COLUMNS, {"table_name", "column_name", "data_type", "ordinal"},
+                                 {ColumnAttribute::TEXT, ColumnAttribute::TEXT, ColumnAttribute::TEXT,
+                                  ColumnAttribute::INT});
+    indices_table = system_table(prefix + INDICES,
+                                 {"table_name", "index_name", "column_name", "seq_in_index", "index_type"},
+                                 {ColumnAttribute::TEXT, ColumnAttribute::TEXT, ColumnAttribute::TEXT,
+                                  ColumnAttribute::INT, ColumnAttribute::TEXT});
+
+    // each table's columns, in ordinal order (rows need not come back in the order they went in)
+    std::map<Identifier, std::vector<std::pair<int32_t, std::pair<Identifier, ColumnAttribute::DataType>>>> schema;
+    Row row(&columns_table->get_column_names());
+    HeapTableIterator *rows = columns_table->scan();
+    while (rows->next()) {
+        rows->get_row(row);
+        ColumnAttribute::DataType data_type = row.get(2).str() == "INT" ? ColumnAttribute::INT : ColumnAttribute::TEXT;
+        schema[row.get(0).str()].push_back(std::make_pair(row.get_int(3), std::make_pair(row.get(1).str(), data_type)));
+    }
+    delete rows;
+
+    row.set_column_names(&tables_table->get_column_names());
+    rows = tables_table->scan();
+    while (rows->next()) {
+        rows->get_row(row);
+        Identifier table_name = row.get(0).str();
+        std::sort(schema[table_name].begin(), schema[table_name].end());
+        ColumnNames column_names;
+        ColumnAttributes column_attributes;
+        for (const auto &column : schema[table_name]) {
+            column_names.push_back(column.second.first);
+            column_attributes.push_back(ColumnAttribute(column.second.second));
+        }
+        HeapTable *table = new HeapTable(table_name, column_names, column_attributes);
+        table->open();
+        tables[table_name] = table;
+    }
+    delete rows;
+
+    // each index's type and key columns, by seq_in_index
+    std::map<std::pair<Identifier, Identifier>, std::pair<Identifier, std::map<int32_t, Identifier>>> definitions;
+    row.set_column_names(&indices_table->get_column_names());
+    rows = indices_table->scan();
+    while (rows->next()) {
+        rows->get_row(row);
+        std::pair<Identifier, std::map<int32_t, Identifier>> &definition =
+                definitions[std::make_pair(row.get(0).str(), row.get(1).str())];
+        definition.first = row.get(4).str();
+        definition.second[row.get_int(3)] = row.get(2).str();
+    }
+    delete rows;
+    for (const auto &definition : definitions) {
+        HeapTable *table = get_table(definition.first.first);
+        if (table == nullptr)
+            throw DbRelationError("Catalog lists index " + definition.first.second + " on unknown table "
+                                  + definition.first.first);
+        ColumnNames key_columns;
+        for (const auto &key_column : definition.second.second)
+            key_columns.push_back(key_column.second);
+        DbIndex *index = make_index(*table, definition.first.second, definition.second.first, key_columns);
+        index->open();
+        table->add_index(index);
+        indices[definition.first] = index;
+    }
+}
+
+/**
+ * Close every table and index, writing out what they have buffered
+ */
+void Catalog::close() {
+    for (auto &index : indices) {
+        index.second->close();
+        delete index.second;
+    }
+    indices.clear();
+    for (auto &table : tables) {
+        table.second->close();
+        delete table.second;
+    }
+    tables.clear();
+    tables_table = columns_table = indices_table = nullptr;
+}
+
+/**
+ * Drop every table and index, and the system tables themselves (the catalog is then closed)
+ */
+void Catalog::drop() {
+    for (auto &index : indices) {
+        index.second->drop();
+        delete index.second;
+    }
+    indices.clear();
+    for (auto &table : tables) {
+        table.second->drop();
+        delete table.second;
+    }
+    tables.clear();
+    tables_table = columns_table = indices_table = nullptr;
+}
+
+/**
+ * Create a table and record it in the catalog: CREATE TABLE
+ * @param table_name the table's name
+ * @param column_names its columns
+ * @param column_attributes their types
+ * @return the new table, open (owned by the catalog)
+ * @throws DbRelationError if there already is such a table, or it cannot be created
+ */
+HeapTable &Catalog::create_table(const Identifier &table_name, const ColumnNames &column_names,
+                                 const ColumnAttributes &column_attributes) {
+    open();
+    if (get_table(table_name) != nullptr)
+        throw DbRelationError("Table " + table_name + " already exists");
+    if (column_names.empty())
+        throw DbRelationError("Table " + table_name + " needs at least one column");
+    HeapTable *table = new HeapTable(table_name, column_names, column_attributes);
+    try {
+        table->create();
+    } catch (DbException &e) {
+        delete table;
+        throw DbRelationError("Could not create " + table_name + ": " + e.what());
+    }
+
+    Row row(&tables_table->get_column_names());
+    row.set(0, table_name);
+    tables_table->insert(row);
+    row.set_column_names(&columns_table->get_column_names());
+    for (uint col_num = 0; col_num < column_names.size(); col_num++) {
+        row.set(0, table_name);
+        row.set(1, column_names[col_num]);
+        row.set(2, column_attributes[col_num].get_data_type() == ColumnAttribute::INT ? "INT" : "TEXT");
+        row.set(3, (int32_t) col_num);
+        columns_table->insert(row);
+    }
+    tables_table->get_buffer_pool().flush();
+    columns_table->get_buffer_pool().flush();
+    tables[table_name] = table;
+    return *table;
+}
+
+/**
+ * Build an index on a table and record it in the catalog: CREATE INDEX
+ * @param table_name the table
+ * @param index_name the index's name (unique among the table's indices)
+ * @param index_type BTREE or HASH
+ * @param key_columns the columns it is on
+ * @return the new index, open and added to the table (owned by the catalog)
+ * @throws DbRelationError if there is no such table, the index exists, or it cannot be built
+ */
+DbIndex &Catalog::create_index(const Identifier &table_name, const Identifier &index_name,
+                               const Identifier &index_type, const ColumnNames &key_columns) {
+    open();
+    HeapTable *table = get_table(table_name);
+    if (table == nullptr)
+        throw DbRelationError("No table " + table_name);
+    if (get_index(table_name, index_name) != nullptr)
+        throw DbRelationError("Index " + index_name + " already exists");
+    DbIndex *index = make_index(*table, index_name, index_type, key_columns);
+    try {
+        index->create();
+    } catch (DbRelationError &e) {
+        delete index;
+        throw;
+    }
+
+    Row row(&indices_table->get_column_names());
+    for (uint seq = 0; seq < key_columns.size(); seq++) {
+        row.set(0, table_name);
+        row.set(1, index_name);
+        row.set(2, key_columns[seq]);
+        row.set(3, (int32_t) seq);
+        row.set(4, index_type);
+        indices_table->insert(row);
+    }
+    indices_table->get_buffer_pool().flush();
+    table->add_index(index);
+    indices[std::make_pair(table_name, index_name)] = index;
+    return *index;
+}
+
+/**
+ * Find an index
+ * @param table_name the table it is on
+ * @param index_name its name
+ * @return the open index, or nullptr if there is none
+ */
+DbIndex *Catalog::get_index(const Identifier &table_name, const Identifier &index_name) const {
+    Indices::const_iterator found = indices.find(std::make_pair(table_name, index_name));
+    return found == indices.end() ? nullptr : found->second;
+}
+
+/**
+ * Open one of the system tables, creating it if this is a new database, and add it to the tables
+ */
+HeapTable *Catalog::system_table(const Identifier &name, const ColumnNames &column_names,
+                                 const ColumnAttributes &column_attributes) {
+    HeapTable *table = new HeapTable(name, column_names, column_attributes);
+    table->create_if_not_exists();
+    tables[name] = table;
+    return table;
+}
+
+/**
+ * Construct (but not create or open) an index of the given type
+ * @throws DbRelationError for a type other than BTREE and HASH, or key columns the type cannot index
+ */
+DbIndex *Catalog::make_index(HeapTable &table, const Identifier &index_name, const Identifier &index_type,
+                             const ColumnNames &key_columns) {
+    if (index_type == "BTREE")
+        return new BTreeIndex(table, index_name, key_columns);
+    if (index_type == "HASH")
+        return new HashIndex(table, index_name, key_columns);
+    throw DbRelationError("Unknown index type " + index_type);
+}
+
+bool test_catalog() {
+    const Identifier prefix = "_test_catalog_cpp";
+    const Identifier table_name = prefix + "_t";
+    ColumnNames column_names;
+    column_names.push_back("id");
+    column_names.push_back("name");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+
+    Catalog *catalog = new Catalog(prefix);
+    catalog->open();
+    bool ok = catalog->get_tables().size() == 3 && catalog->get_table(prefix + Catalog::COLUMNS) != nullptr;
+    HeapTable &table = catalog->create_table(table_name, column_names, column_attributes);
+    Row row(&table.get_column_names());
+    for (int32_t id = 0; id < 10; id++) {
+        row.set(0, id);
+        row.set(1, "name " + std::to_string(id));
+        table.insert(row);
+    }
+    catalog->create_index(table_name, "by_id", "BTREE", ColumnNames(1, "id"));
+    try {
+        catalog->create_table(table_name, column_names, column_attributes);
+        ok = false;
+    } catch (DbRelationError &e) {
+    }
+    ok = ok && catalog->get_table(prefix + Catalog::COLUMNS)->count() == 2;
+    delete catalog;
+
+    // everything comes back in a new catalog, the index included
+    catalog = new Catalog(prefix);
+    catalog->open();
+    HeapTable *reopened = catalog->get_table(table_name);
+    ok = ok && reopened != nullptr && reopened->get_column_names() == column_names
+         && reopened->get_column_attributes()[0].get_data_type() == ColumnAttribute::INT
+         && reopened->get_column_attributes()[1].get_data_type() == ColumnAttribute::TEXT
+         && reopened->count() == 10 && reopened->get_indices().size() == 1
+         && catalog->get_index(table_name, "by_id") != nullptr;
+    if (ok) {
+        Predicates where;
+        where.push_back(Predicate("id", Predicate::EQ, Value(3)));
+        Handles *handles = reopened->select(where);
+        ok = handles->size() == 1;
+        delete handles;
+    }
+    if (!ok)
+        std::cout << "catalog did not keep the right schema" << std::endl;
+    catalog->drop();
+    delete catalog;
+    return ok;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file catalog.h - Persistent schema catalog with an in-memory cache of open tables and indices.
+ * Catalog
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include "eval_plan.h"
+
+/**
+ * @class Catalog - the tables and indices of the database, by name
+ *
+ *      The schema is stored in three system heap tables, which can be queried like any other:
+            _tables  (table_name TEXT)
+            _columns (table_name TEXT, column_name TEXT, data_type TEXT, ordinal INT)
+            _indices (table_name TEXT, index_name TEXT, column_name TEXT, seq_in_index INT, index_type TEXT)
+        open() reads them once and opens every table and index they list; the HeapTables (with
+        their indices added) then stay open until the Catalog is destroyed, so finding a table for
+        a statement is one hash lookup. Changes to the schema are written to the system tables and
+        flushed before create_table() or create_index() returns.
+ */
+class Catalog {
+public:
+    static const Identifier TABLES;
+    static const Identifier COLUMNS;
+    static const Identifier INDICES;
+
+    /**
+     * @param prefix  prepended to the system tables' names (so tests get a catalog of their own)
+     */
+    Catalog(Identifier prefix = "");
+
+    virtual ~Catalog();
+
+    Catalog(const Catalog &other) = delete;
+
+    Catalog(Catalog &&temp) = delete;
+
+    Catalog &operator=(const Catalog &other) = delete;
+
+    Catalog &operator=(Catalog &&temp) = delete;
+
+    virtual void open(void);
+
+    virtual void close(void);
+
+    virtual void drop(void);
+
+    virtual HeapTable &create_table(const Identifier &table_name, const ColumnNames &column_names,
+                                    const ColumnAttributes &column_attributes);
+
+    virtual DbIndex &create_index(const Identifier &table_name, const Identifier &index_name,
+                                  const Identifier &index_type, const ColumnNames &key_columns);
+
+    /**
+     * Find a table
+     * @param table_name  its name
+     * @return the open table, or nullptr if there is none by that name
+     */
+    virtual HeapTable *get_table(const Identifier &table_name) const {
+        Tables::const_iterator found = tables.find(table_name);
+        return found == tables.end() ? nullptr : found->second;
+    }
+
+    virtual DbIndex *get_index(const Identifier &table_name, const Identifier &index_name) const;
+
+    virtual const Tables &get_tables() const { return tables; }
+
+protected:
+    typedef std::map<std::pair<Identifier, Identifier>, DbIndex *> Indices;
+
+    Identifier prefix;
+    HeapTable *tables_table;
+    HeapTable *columns_table;
+    HeapTable *indices_table;
+    Tables tables;          // every table, system tables included
+    Indices indices;        // by table name and index name
+
+    virtual HeapTable *system_table(const Identifier &name, const ColumnNames &column_names,
+                                    const ColumnAttributes &column_attributes);
+
+    virtual DbIndex *make_index(HeapTable &table, const Identifier &index_name, const Identifier &index_type,
+                                const ColumnNames &key_columns);
+};
+
+bool test_catalog();
@@ -0,0 +1,936 @@
+#include "eval_plan.h"
+#include "hash_join.h"
+#include "sort.h"
+#include "hash_aggregate.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+
+size_t EvalPlan::row_bytes(const Row &row) {
+    size_t bytes = sizeof(Row) + row.size() * 24; // a slot, plus an operator's own entries for it
+    for (uint col_num = 0; col_num < row.size(); col_num++)
+        if (row.get_data_type(col_num) == ColumnAttribute::TEXT)
+            bytes += row.get(col_num).s_size;
+    return bytes;
+}
+
+/**
+ * @class TableScan
+ *
+ * Reads a table's rows into batches.
+ */
+
+/**
+ * @param table the table to read
+ * @param where predicates the rows must satisfy (checked against the schema when the scan is opened)
+ */
+TableScan::TableScan(HeapTable &table, Predicates where) : table(table), where(where), values(), rows(nullptr),
+            handles(nullptr), position(0) {
+    for (const Predicate &predicate : where)
+        values.push_back(Literal(predicate.value));
+}
+
+TableScan::~TableScan() {
+    close();
+}
+
+/**
+ * Start reading the table
+ * @throws DbRelationError if a predicate names a missing column or has the wrong type of value
+ */
+void TableScan::open() {
+    close();
+    for (size_t i = 0; i < where.size(); i++)
+        where[i].value = values[i].get();
+    if (where.empty())
+        rows = table.scan();
+    else
+        handles = table.select(where);
+    position = 0;
+}
+
+/**
+ * Get the next rows of the table
+ * @param batch filled with the table's next rows
+ * @return false when there are no more
+ */
+bool TableScan::next(RowBatch &batch) {
+    batch.clear();
+    const ColumnNames *column_names = &table.get_column_names();
+    if (rows != nullptr) {
+        while (!batch.full() && rows->next())
+            rows->get_row(batch.add(column_names));
+    } else if (handles != nullptr) {
+        while (!batch.full() && position < handles->size())
+            table.project((*handles)[position++], batch.add(column_names));
+    }
+    return !batch.empty();
+}
+
+void TableScan::close() {
+    delete rows;
+    rows = nullptr;
+    delete handles;
+    handles = nullptr;
+}
+
+/**
+ * @class TableCount
+ *
+ * Counts a table's rows from its blocks' headers.
+ */
+
+/**
+ * @param table the table to count
+ * @param column_names the names of the (INT) columns, each of which gets the count
+ */
+TableCount::TableCount(HeapTable &table, ColumnNames column_names) : table(table), column_names(column_names),
+            column_attributes(column_names.size(), ColumnAttribute(ColumnAttribute::INT)), n(0), done(true) {
+}
+
+/**
+ * Count the rows
+ * @throws DbRelationError if there are too many for an INT
+ */
+void TableCount::open() {
+    n = table.count();
+    if (n > INT32_MAX)
+        throw DbRelationError("COUNT(*) is out of range for INT");
+    done = false;
+}
+
+/**
+ * Get the count
+ * @param batch filled with the one row, the first time
+ * @return false after the first time
+ */
+bool TableCount::next(RowBatch &batch) {
+    batch.clear();
+    if (done)
+        return false;
+    Row &row = batch.add(&column_names);
+    for (uint col_num = 0; col_num < column_names.size(); col_num++)
+        row.set(col_num, (int32_t) n);
+    done = true;
+    return true;
+}
+
+/**
+ * @class Filter
+ *
+ * Drops the rows of its input's batches that fail its condition.
+ */
+
+Filter::~Filter() {
+    delete input;
+    delete condition;
+}
+
+/**
+ * Get the next rows of the input that satisfy the condition
+ * The input's batch is compacted in place, so no rows are copied.
+ * @param batch filled with the next rows
+ * @return false when there are no more
+ */
+bool Filter::next(RowBatch &batch) {
+    while (input->next(batch)) {
+        uint kept = 0;
+        for (uint i = 0; i < batch.size(); i++) {
+            if (condition->holds(batch[i])) {
+                if (kept != i)
+                    batch.swap(kept, i);
+                kept++;
+            }
+        }
+        batch.truncate(kept);
+        if (kept > 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @class Project
+ *
+ * Copies some of its input's columns into rows of its own.
+ */
+
+/**
+ * @param input the plan whose rows are projected (owned)
+ * @param col_nums the input column for each output column
+ * @param column_names the output columns' names
+ */
+Project::Project(EvalPlan *input, std::vector<uint> col_nums, ColumnNames column_names) : input(input),
+            col_nums(col_nums), column_names(column_names), column_attributes(), input_batch() {
+    for (uint col_num : col_nums)
+        column_attributes.push_back(input->get_column_attributes()[col_num]);
+}
+
+/**
+ * Get the next rows, with just the projected columns
+ * @param batch filled with the next rows
+ * @return false when there are no more
+ */
+bool Project::next(RowBatch &batch) {
+    batch.clear();
+    if (!input->next(input_batch))
+        return false;
+    for (uint i = 0; i < input_batch.size(); i++) {
+        const Row &in = input_batch[i];
+        Row &out = batch.add(&column_names);
+        for (uint col_num = 0; col_num < col_nums.size(); col_num++)
+            out.set(col_num, in, col_nums[col_num]);
+    }
+    return true;
+}
+
+/**
+ * @class Limit
+ *
+ * Passes on a window of its input's rows.
+ */
+
+void Limit::open() {
+    skipped = 0;
+    returned = 0;
+    input->open();
+}
+
+/**
+ * Get the next rows inside the window
+ * @param batch filled with the next rows
+ * @return false when there are no more, or limit rows have been returned
+ */
+bool Limit::next(RowBatch &batch) {
+    batch.clear();
+    while (returned < limit && input->next(batch)) {
+        uint begin = (uint) std::min((u_int64_t) batch.size(), offset - skipped);
+        skipped += begin;
+        uint end = (uint) std::min((u_int64_t) batch.size(), begin + (limit - returned));
+        if (begin == end)
+            continue;
+        for (uint i = begin; i < end; i++)
+            batch.swap(i - begin, i);
+        batch.truncate(end - begin);
+        returned += end - begin;
+        return true;
+    }
+    batch.clear();
+    return false;
+}
+
+/**
+ * @class Scope - the columns of the rows a plan produces, and the table each came from
+ *
+ * Resolves the (possibly qualified) column names in a query to column ordinals.
+ */
+class Scope {
+public:
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    std::vector<Identifier> tables;     // table name of each column
+    std::vector<Identifier> aliases;    // name the query gives the table of each column
+    const Bindings *bindings;           // the statement's parameters, if its plan is to be reused
+
+    Scope() : column_names(), column_attributes(), tables(), aliases(), bindings(nullptr) {}
+
+    uint size() const { return (uint) column_names.size(); }
+
+    /**
+     * Add the columns of a table
+     * @param table the table
+     * @param alias what the query calls it (its name, unless the query gives it an alias)
+     */
+    void add(const HeapTable &table, Identifier alias) {
+        for (uint col_num = 0; col_num < table.get_column_names().size(); col_num++) {
+            column_names.push_back(table.get_column_names()[col_num]);
+            column_attributes.push_back(table.get_column_attributes()[col_num]);
+            tables.push_back(table.get_table_name());
+            aliases.push_back(alias);
+        }
+    }
+
+    /**
+     * Find the column a column reference names among some of the columns
+     * @param expr the column reference
+     * @param begin first column to look at
+     * @param end one past the last
+     * @return its ordinal, or -1 if none of them matches
+     * @throws PlanError if it has no qualifier and more than one matches
+     */
+    int lookup(const hsql::Expr *expr, uint begin, uint end) const {
+        std::string qualifier = expr->table == nullptr ? "" : expr->table;
+        std::string name = expr->name == nullptr ? "" : expr->name;
+        int found = -1;
+        for (uint col_num = begin; col_num < end; col_num++) {
+            if (column_names[col_num] != name)
+                continue;
+            if (!qualifier.empty() && qualifier != aliases[col_num] && qualifier != tables[col_num])
+                continue;
+            if (found >= 0)
+                throw PlanError("Column " + name + " is ambiguous");
+            found = (int) col_num;
+        }
+        return found;
+    }
+
+    /**
+     * Find the column a column reference names
+     * @param expr the column reference
+     * @param begin first column it can name
+     * @param end one past the last
+     * @return its ordinal, counted from begin
+     * @throws PlanError if there is no such column, or no qualifier and more than one
+     */
+    uint find(const hsql::Expr *expr, uint begin, uint end) const {
+        int found = lookup(expr, begin, end);
+        if (found < 0)
+            throw PlanError("No such column " + (expr->table == nullptr ? "" : std::string(expr->table) + ".")
+                            + (expr->name == nullptr ? "" : expr->name));
+        return (uint) found - begin;
+    }
+
+    uint find(const hsql::Expr *expr) const { return find(expr, 0, size()); }
+};
+
+/**
+ * @class ScanInfo - a TableScan in the plan being built, and where its columns are in the plan's rows
+ */
+struct ScanInfo {
+    TableScan *scan;
+    uint begin;         // its first column
+    uint end;           // one past its last
+    bool nullable;      // on the NULL side of an outer join, so predicates cannot be pushed into it
+};
+
+/**
+ * Get the comparison operator of an expression
+ * @param expr the expression
+ * @param op set to the operator
+ * @return false if expr is not a comparison
+ */
+static bool comparison_op(const hsql::Expr *expr, Predicate::Op &op) {
+    if (expr->type != hsql::kExprOperator)
+        return false;
+    switch (expr->opType) {
+        case hsql::Expr::SIMPLE_OP:
+            switch (expr->opChar) {
+                case '=':
+                    op = Predicate::EQ;
+                    return true;
+                case '<':
+                    op = Predicate::LT;
+                    return true;
+                case '>':
+                    op = Predicate::GT;
+                    return true;
+                default:
+                    return false;
+            }
+        case hsql::Expr::NOT_EQUALS:
+            op = Predicate::NE;
+            return true;
+        case hsql::Expr::LESS_EQ:
+            op = Predicate::LE;
+            return true;
+        case hsql::Expr::GREATER_EQ:
+            op = Predicate::GE;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * The operator that gives the same result with the operands swapped (e.g. 3 < a is a > 3)
+ * @param op the operator
+ * @return the mirrored operator
+ */
+static Predicate::Op mirror(Predicate::Op op) {
+    switch (op) {
+        case Predicate::LT:
+            return Predicate::GT;
+        case Predicate::LE:
+            return Predicate::GE;
+        case Predicate::GT:
+            return Predicate::LT;
+        case Predicate::GE:
+            return Predicate::LE;
+        default:
+            return op;
+    }
+}
+
+/**
+ * Compile a literal: a parameter of the statement if its bindings say so, else its value now
+ * @param expr the literal (or the negation of an INT literal)
+ * @param scope has the statement's bindings
+ * @param value the literal's value
+ * @return the literal
+ */
+static Literal literal(const hsql::Expr *expr, const Scope &scope, const Value &value) {
+    if (scope.bindings != nullptr) {
+        std::map<const hsql::Expr *, uint>::const_iterator slot = scope.bindings->slots.find(expr);
+        if (slot != scope.bindings->slots.end())
+            return Literal(scope.bindings->params, slot->second);
+    }
+    return Literal(value);
+}
+
+/**
+ * Compile one side of a comparison
+ * @param expr a column reference or an INT or TEXT literal
+ * @param scope the columns of the query
+ * @param begin first column it can name (which is column 0 of the rows it is evaluated on)
+ * @param end one past the last
+ * @param data_type set to the operand's type
+ * @return the operand
+ * @throws PlanError for any other expression
+ */
+static Comparison::Operand operand(const hsql::Expr *expr, const Scope &scope, uint begin, uint end,
+                                   ColumnAttribute::DataType &data_type) {
+    Comparison::Operand result{-1, Literal()};
+    switch (expr->type) {
+        case hsql::kExprColumnRef:
+            result.col_num = (int) scope.find(expr, begin, end);
+            data_type = scope.column_attributes[begin + result.col_num].get_data_type();
+            return result;
+        case hsql::kExprLiteralInt:
+            if (expr->ival < INT32_MIN || expr->ival > INT32_MAX)
+                throw PlanError("INT literal out of range: " + std::to_string(expr->ival));
+            result.literal = literal(expr, scope, Value((int32_t) expr->ival));
+            data_type = ColumnAttribute::INT;
+            return result;
+        case hsql::kExprLiteralString:
+            result.literal = literal(expr, scope, Value(std::string(expr->name)));
+            data_type = ColumnAttribute::TEXT;
+            return result;
+        case hsql::kExprOperator:
+            if (expr->opType == hsql::Expr::UMINUS && expr->expr->type == hsql::kExprLiteralInt
+                && -expr->expr->ival >= INT32_MIN) {
+                result.literal = literal(expr, scope, Value((int32_t) -expr->expr->ival));
+                data_type = ColumnAttribute::INT;
+                return result;
+            }
+            // fall through
+        default:
+            throw PlanError("Only columns and INT or TEXT literals can be compared");
+    }
+}
+
+/**
+ * Compile a boolean expression
+ * @param expr comparisons combined with AND, OR and NOT
+ * @param scope the columns of the query
+ * @param begin first column it can name (which is column 0 of the rows it is evaluated on)
+ * @param end one past the last
+ * @return the condition (freed by caller)
+ * @throws PlanError if the expression is not supported or compares values of different types
+ */
+static Condition *condition(const hsql::Expr *expr, const Scope &scope, uint begin, uint end) {
+    Predicate::Op op;
+    if (comparison_op(expr, op)) {
+        ColumnAttribute::DataType left_type, right_type;
+        Comparison::Operand left = operand(expr->expr, scope, begin, end, left_type);
+        Comparison::Operand right = operand(expr->expr2, scope, begin, end, right_type);
+        if (left_type != right_type)
+            throw PlanError("Incorrect data type");
+        return new Comparison(left, op, right);
+    }
+    if (expr->type == hsql::kExprOperator && expr->opType == hsql::Expr::NOT)
+        return new Negation(condition(expr->expr, scope, begin, end));
+    if (expr->type == hsql::kExprOperator && (expr->opType == hsql::Expr::AND || expr->opType == hsql::Expr::OR)) {
+        std::vector<Condition *> terms;
+        terms.push_back(condition(expr->expr, scope, begin, end));
+        try {
+            terms.push_back(condition(expr->expr2, scope, begin, end));
+        } catch (...) {
+            delete terms[0];
+            throw;
+        }
+        return new Conjunction(expr->opType == hsql::Expr::AND, terms);
+    }
+    throw PlanError("Unsupported WHERE clause");
+}
+
+/**
+ * Compile the parts of a where clause that must all hold
+ * @param parts the parts
+ * @param scope the columns of the query
+ * @param begin first column they can name (which is column 0 of the rows they are evaluated on)
+ * @param end one past the last
+ * @return the condition (freed by caller), or nullptr if there are no parts
+ */
+static Condition *conjunction(const std::vector<const hsql::Expr *> &parts, const Scope &scope, uint begin, uint end) {
+    std::vector<Condition *> terms;
+    try {
+        for (const hsql::Expr *part : parts)
+            terms.push_back(condition(part, scope, begin, end));
+    } catch (...) {
+        for (Condition *term : terms)
+            delete term;
+        throw;
+    }
+    if (terms.empty())
+        return nullptr;
+    if (terms.size() == 1)
+        return terms[0];
+    return new Conjunction(true, terms);
+}
+
+/**
+ * Split a where clause at its top-level ANDs
+ * @param expr the where clause
+ * @param parts the parts, all of which must hold, are appended to this
+ */
+static void conjuncts(const hsql::Expr *expr, std::vector<const hsql::Expr *> &parts) {
+    if (expr->type == hsql::kExprOperator && expr->opType == hsql::Expr::AND) {
+        conjuncts(expr->expr, parts);
+        conjuncts(expr->expr2, parts);
+    } else {
+        parts.push_back(expr);
+    }
+}
+
+/**
+ * Hand a comparison of a column with a literal to the scan of the column's table, so the table
+ * can evaluate it itself (with an index or its zone map)
+ * @param expr part of a where clause
+ * @param scope the columns of the query
+ * @param scans the query's table scans
+ * @return false if expr is not such a comparison, or the table is on the NULL side of an outer join
+ */
+static bool push_down(const hsql::Expr *expr, const Scope &scope, std::vector<ScanInfo> &scans) {
+    Predicate::Op op;
+    if (!comparison_op(expr, op))
+        return false;
+    const hsql::Expr *column = expr->expr;
+    const hsql::Expr *literal = expr->expr2;
+    if (column->type != hsql::kExprColumnRef) {
+        std::swap(column, literal);
+        op = mirror(op);
+    }
+    if (column->type != hsql::kExprColumnRef || literal->type == hsql::kExprColumnRef)
+        return false;
+    ColumnAttribute::DataType column_type, literal_type;
+    uint col_num = (uint) operand(column, scope, 0, scope.size(), column_type).col_num;
+    Comparison::Operand literal_operand = operand(literal, scope, 0, scope.size(), literal_type);
+    if (column_type != literal_type)
+        throw PlanError("Incorrect data type");
+    for (ScanInfo &scan : scans) {
+        if (scan.begin <= col_num && col_num < scan.end) {
+            if (scan.nullable)
+                return false;
+            scan.scan->add_predicate(Predicate(scope.column_names[col_num], op, literal_operand.literal.get()),
+                                     literal_operand.literal);
+            return true;
+        }
+    }
+    return false;
+}
+
+static EvalPlan *plan_from(const hsql::TableRef *from, const Tables &tables, Scope &scope,
+                           std::vector<ScanInfo> &scans);
+
+/**
+ * Build the plan for a JOIN: a HashJoin on the ON clause's equality of a column from each side
+ * For an inner join, the rest of the ON clause is a Filter on the join.
+ * @param join the parsed join
+ * @param tables the tables it can name
+ * @param scope gets the columns of both sides
+ * @param scans gets the table scans of both sides
+ * @return the plan (freed by caller)
+ * @throws PlanError if the join is not an equi-join of a supported type
+ */
+static EvalPlan *plan_join(const hsql::JoinDefinition *join, const Tables &tables, Scope &scope,
+                           std::vector<ScanInfo> &scans) {
+    HashJoin::JoinType type;
+    switch (join->type) {
+        case hsql::kJoinInner:
+            type = HashJoin::INNER;
+            break;
+        case hsql::kJoinLeft:
+            type = HashJoin::LEFT;
+            break;
+        case hsql::kJoinRight:
+            type = HashJoin::RIGHT;
+            break;
+        case hsql::kJoinOuter:
+            type = HashJoin::FULL;
+            break;
+        default:
+            throw PlanError("Only JOIN, LEFT JOIN, RIGHT JOIN and OUTER JOIN are supported");
+    }
+    if (join->condition == nullptr)
+        throw PlanError("JOIN needs an ON clause");
+
+    uint begin = scope.size();
+    EvalPlan *left = plan_from(join->left, tables, scope, scans);
+    uint middle = scope.size();
+    EvalPlan *right = nullptr;
+    Condition *rest = nullptr;
+    int left_key = -1, right_key = -1;
+    try {
+        right = plan_from(join->right, tables, scope, scans);
+        uint end = scope.size();
+
+        std::vector<const hsql::Expr *> parts, others;
+        conjuncts(join->condition, parts);
+        for (const hsql::Expr *part : parts) {
+            Predicate::Op op;
+            if (left_key < 0 && comparison_op(part, op) && op == Predicate::EQ
+                && part->expr->type == hsql::kExprColumnRef && part->expr2->type == hsql::kExprColumnRef) {
+                int a = scope.lookup(part->expr, begin, end);
+                int b = scope.lookup(part->expr2, begin, end);
+                if (a >= (int) middle && b >= (int) begin && b < (int) middle)
+                    std::swap(a, b);
+                if (a >= (int) begin && a < (int) middle && b >= (int) middle) {
+                    if (scope.column_attributes[a].get_data_type() != scope.column_attributes[b].get_data_type())
+                        throw PlanError("Incorrect data type");
+                    left_key = a - (int) begin;
+                    right_key = b - (int) middle;
+                    continue;
+                }
+            }
+            others.push_back(part);
+        }
+        if (left_key < 0)
+            throw PlanError("JOIN's ON clause must compare a column of each side with =");
+        if (type != HashJoin::INNER && !others.empty())
+            throw PlanError("An outer JOIN's ON clause can only compare a column of each side with =");
+        rest = conjunction(others, scope, begin, end);
+
+        for (ScanInfo &scan : scans) {
+            bool on_left = begin <= scan.begin && scan.begin < middle;
+            bool on_right = middle <= scan.begin && scan.begin < end;
+            if ((on_left && (type == HashJoin::RIGHT || type == HashJoin::FULL))
+                || (on_right && (type == HashJoin::LEFT || type == HashJoin::FULL)))
+                scan.nullable = true;
+        }
+    } catch (...) {
+        delete left;
+        delete right;
+        throw;
+    }
+    EvalPlan *plan = new HashJoin(left, right, (uint) left_key, (uint) right_key, type);
+    if (rest != nullptr)
+        plan = new Filter(plan, rest);
+    return plan;
+}
+
+/**
+ * Build the plan for a FROM clause: a table or a tree of JOINs
+ * @param from the parsed FROM clause
+ * @param tables the tables it can name
+ * @param scope gets the columns of its rows
+ * @param scans gets its table scans
+ * @return the plan (freed by caller)
+ * @throws PlanError if it names an unknown table or is not supported
+ */
+static EvalPlan *plan_from(const hsql::TableRef *from, const Tables &tables, Scope &scope,
+                           std::vector<ScanInfo> &scans) {
+    switch (from->type) {
+        case hsql::kTableName: {
+            Tables::const_iterator table = tables.find(from->name);
+            if (table == tables.end())
+                throw PlanError("No table " + std::string(from->name));
+            uint begin = scope.size();
+            scope.add(*table->second, from->alias == nullptr ? from->name : from->alias);
+            TableScan *scan = new TableScan(*table->second);
+            scans.push_back(ScanInfo{scan, begin, scope.size(), false});
+            return scan;
+        }
+        case hsql::kTableJoin:
+            return plan_join(from->join, tables, scope, scans);
+        default:
+            throw PlanError("Only tables and JOINs can be selected from");
+    }
+}
+
+/**
+ * Resolve an ORDER BY column: a name given in the select list, or any column of the query
+ * @param expr the ORDER BY expression
+ * @param scope the columns of the query
+ * @param col_nums the column of each select list entry
+ * @param column_names the name of each select list entry
+ * @return the column's ordinal
+ * @throws PlanError if expr is not a column reference, or names no column
+ */
+static uint order_column(const hsql::Expr *expr, const Scope &scope, const std::vector<uint> &col_nums,
+                         const ColumnNames &column_names) {
+    if (expr->type != hsql::kExprColumnRef)
+        throw PlanError("Only columns can be ordered by");
+    if (expr->table == nullptr && scope.lookup(expr, 0, scope.size()) < 0)
+        for (uint i = 0; i < column_names.size(); i++)
+            if (column_names[i] == expr->name)
+                return col_nums[i];
+    return scope.find(expr);
+}
+
+/**
+ * Get the aggregate function an expression calls
+ * @param expr the expression
+ * @param function set to the function
+ * @return false if expr is not a function call
+ * @throws PlanError if it calls a function other than COUNT, SUM, MIN, MAX and AVG
+ */
+static bool aggregate_function(const hsql::Expr *expr, HashAggregate::Function &function) {
+    if (expr->type != hsql::kExprFunctionRef)
+        return false;
+    std::string name = expr->name == nullptr ? "" : expr->name;
+    for (char &c : name)
+        c = (char) std::toupper(c);
+    if (name == "COUNT")
+        function = HashAggregate::COUNT;
+    else if (name == "SUM")
+        function = HashAggregate::SUM;
+    else if (name == "MIN")
+        function = HashAggregate::MIN;
+    else if (name == "MAX")
+        function = HashAggregate::MAX;
+    else if (name == "AVG")
+        function = HashAggregate::AVG;
+    else
+        throw PlanError("Unknown function " + name);
+    return true;
+}
+
+/**
+ * Whether a SELECT statement groups its rows: it has a GROUP BY or aggregates in its select list
+ */
+static bool is_aggregate(const hsql::SelectStatement *select) {
+    if (select->groupBy != nullptr)
+        return true;
+    for (const hsql::Expr *expr : *select->selectList)
+        if (expr->type == hsql::kExprFunctionRef)
+            return true;
+    return false;
+}
+
+/**
+ * Build the plan for GROUP BY and the select list's aggregates
+ *      A HashAggregate, or for SELECT COUNT(*) FROM table with no WHERE a TableCount, which counts
+ *      the rows from the blocks' headers.
+ * @param select the parsed statement
+ * @param tables the tables it can name
+ * @param plan the plan for the rows to aggregate (freed here if it is not the new plan's input)
+ * @param scope the columns of the query, replaced by the aggregated rows' columns: the group
+ *              columns, then one for each aggregate
+ * @param aggregate_cols set to the column each aggregate in the select list ends up in
+ * @return the plan (freed by caller)
+ * @throws PlanError if the grouping or an aggregate is not supported
+ */
+static EvalPlan *plan_aggregate(const hsql::SelectStatement *select, const Tables &tables, EvalPlan *plan,
+                                Scope &scope, std::map<const hsql::Expr *, uint> &aggregate_cols) {
+    std::vector<uint> group_col_nums;
+    if (select->groupBy != nullptr) {
+        if (select->groupBy->having != nullptr)
+            throw PlanError("HAVING is not supported");
+        for (const hsql::Expr *expr : *select->groupBy->columns) {
+            if (expr->type != hsql::kExprColumnRef)
+                throw PlanError("Only columns can be grouped by");
+            uint col_num = scope.find(expr);
+            if (std::find(group_col_nums.begin(), group_col_nums.end(), col_num) == group_col_nums.end())
+                group_col_nums.push_back(col_num);
+        }
+    }
+    Scope grouped;
+    grouped.bindings = scope.bindings;
+    for (uint col_num : group_col_nums) {
+        grouped.column_names.push_back(scope.column_names[col_num]);
+        grouped.column_attributes.push_back(scope.column_attributes[col_num]);
+        grouped.tables.push_back(scope.tables[col_num]);
+        grouped.aliases.push_back(scope.aliases[col_num]);
+    }
+
+    HashAggregate::Aggregates aggregates;
+    bool only_count_star = true;
+    for (const hsql::Expr *expr : *select->selectList) {
+        HashAggregate::Function function;
+        if (expr->type == hsql::kExprStar)
+            throw PlanError("SELECT * cannot be used with GROUP BY or aggregates");
+        if (expr->type == hsql::kExprColumnRef) {
+            if (std::find(group_col_nums.begin(), group_col_nums.end(), scope.find(expr)) == group_col_nums.end())
+                throw PlanError("Column " + std::string(expr->name) + " must be in GROUP BY or an aggregate");
+            continue;
+        }
+        if (!aggregate_function(expr, function))
+            throw PlanError("Only columns and aggregates can be selected");
+        std::string label = expr->name;
+        for (char &c : label)
+            c = (char) std::toupper(c);
+        if (expr->distinct)
+            throw PlanError("DISTINCT " + label + " is not supported");
+        if (expr->exprList == nullptr || expr->exprList->size() != 1)
+            throw PlanError(label + " takes one column");
+        const hsql::Expr *arg = expr->exprList->at(0);
+        HashAggregate::Aggregate aggregate{function, 0};
+        ColumnAttribute attribute(ColumnAttribute::INT);
+        if (arg->type == hsql::kExprStar && function == HashAggregate::COUNT) {
+            aggregate.function = HashAggregate::COUNT_STAR;
+            label += "(*)";
+        } else if (arg->type == hsql::kExprColumnRef) {
+            aggregate.col_num = scope.find(arg);
+            if (function == HashAggregate::MIN || function == HashAggregate::MAX)
+                attribute = scope.column_attributes[aggregate.col_num];
+            else if ((function == HashAggregate::SUM || function == HashAggregate::AVG)
+                     && scope.column_attributes[aggregate.col_num].get_data_type() != ColumnAttribute::INT)
+                throw PlanError(label + " needs an INT column");
+            label += "(" + (arg->table == nullptr ? "" : std::string(arg->table) + ".") + arg->name + ")";
+        } else {
+            throw PlanError(label + " takes one column");
+        }
+        only_count_star = only_count_star && aggregate.function == HashAggregate::COUNT_STAR;
+        aggregate_cols[expr] = grouped.size();
+        aggregates.push_back(aggregate);
+        grouped.column_names.push_back(expr->alias != nullptr ? expr->alias : label);
+        grouped.column_attributes.push_back(attribute);
+        grouped.tables.push_back("");
+        grouped.aliases.push_back("");
+    }
+
+    scope = grouped;
+    if (only_count_star && group_col_nums.empty() && select->whereClause == nullptr
+        && select->fromTable->type == hsql::kTableName) {
+        EvalPlan *count = new TableCount(*tables.at(select->fromTable->name), scope.column_names);
+        delete plan;
+        return count;
+    }
+    return new HashAggregate(plan, group_col_nums, aggregates, scope.column_names);
+}
+
+/**
+ * Build the plan for a SELECT statement
+ *      FROM (TableScans, HashJoins) -> Filter (the where clause, less the comparisons of a column
+ *      with a literal that were pushed into the TableScans) -> HashAggregate (for GROUP BY or
+ *      aggregates) -> Sort (keeping just the rows LIMIT needs) -> Limit -> Project (unless SELECT *)
+ * @param select the parsed statement
+ * @param tables the tables it can name
+ * @param bindings which of its literals are parameters (nullptr if none are): the plan reads their
+ *                 values from bindings->params each time it is opened
+ * @return the plan (freed by caller)
+ * @throws PlanError if the statement names unknown tables or columns or uses unsupported SQL
+ */
+EvalPlan *plan_select(const hsql::SelectStatement *select, const Tables &tables, const Bindings *bindings) {
+    if (select->fromTable == nullptr)
+        throw PlanError("SELECT needs a FROM clause");
+    if (select->selectDistinct || select->unionSelect != nullptr)
+        throw PlanError("DISTINCT and UNION are not supported");
+    Scope scope;
+    scope.bindings = bindings;
+    std::vector<ScanInfo> scans;
+    EvalPlan *plan = plan_from(select->fromTable, tables, scope, scans);
+    try {
+        std::vector<const hsql::Expr *> residual;
+        if (select->whereClause != nullptr) {
+            std::vector<const hsql::Expr *> parts;
+            conjuncts(select->whereClause, parts);
+            for (const hsql::Expr *part : parts)
+                if (!push_down(part, scope, scans))
+                    residual.push_back(part);
+        }
+        Condition *where = conjunction(residual, scope, 0, scope.size());
+        if (where != nullptr)
+            plan = new Filter(plan, where);
+
+        std::map<const hsql::Expr *, uint> aggregate_cols;
+        if (is_aggregate(select))
+            plan = plan_aggregate(select, tables, plan, scope, aggregate_cols);
+
+        std::vector<uint> col_nums;
+        ColumnNames column_names;
+        for (const hsql::Expr *expr : *select->selectList) {
+            if (expr->type == hsql::kExprStar) {
+                for (uint col_num = 0; col_num < scope.size(); col_num++) {
+                    col_nums.push_back(col_num);
+                    column_names.push_back(scope.column_names[col_num]);
+                }
+            } else if (expr->type == hsql::kExprColumnRef) {
+                col_nums.push_back(scope.find(expr));
+                column_names.push_back(expr->alias != nullptr ? expr->alias : expr->name);
+            } else if (aggregate_cols.count(expr) > 0) {
+                col_nums.push_back(aggregate_cols[expr]);
+                column_names.push_back(scope.column_names[col_nums.back()]);
+            } else {
+                throw PlanError("Only columns and aggregates can be selected");
+            }
+        }
+
+        u_int64_t limit = UINT64_MAX, offset = 0;
+        if (select->limit != nullptr) {
+            limit = select->limit->limit < 0 ? UINT64_MAX : (u_int64_t) select->limit->limit;
+            offset = select->limit->offset < 0 ? 0 : (u_int64_t) select->limit->offset;
+        }
+        if (select->order != nullptr) {
+            Sort::SortKeys keys;
+            for (const hsql::OrderDescription *order : *select->order)
+                keys.push_back(Sort::SortKey{order_column(order->expr, scope, col_nums, column_names),
+                                             order->type == hsql::kOrderDesc});
+            plan = new Sort(plan, keys, limit > UINT64_MAX - offset ? UINT64_MAX : limit + offset);
+        }
+        if (select->limit != nullptr)
+            plan = new Limit(plan, limit, offset);
+        bool identity = column_names == scope.column_names;
+        for (uint i = 0; identity && i < col_nums.size(); i++)
+            identity = col_nums[i] == i;
+        if (!identity)
+            plan = new Project(plan, col_nums, column_names);
+    } catch (...) {
+        delete plan;
+        throw;
+    }
+    return plan;
+}
+
+bool test_eval_plan() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_eval_plan_cpp", column_names, column_attributes);
+    table.create();
+    Rows rows(2500, Row(&table.get_column_names()));
+    for (int i = 0; i < 2500; i++) {
+        rows[i].set(0, i);
+        rows[i].set(1, "row " + std::to_string(i));
+    }
+    delete table.insert_batch(rows);
+
+    // every row, across several batches
+    RowBatch batch;
+    TableScan scan(table);
+    scan.open();
+    uint n = 0;
+    while (scan.next(batch))
+        n += batch.size();
+    scan.close();
+    bool ok = n == 2500;
+
+    // SELECT b, a FROM table WHERE a >= 10 AND b <> 'row 15' LIMIT 5 OFFSET 2
+    Predicates where;
+    where.push_back(Predicate("a", Predicate::GE, Value(10)));
+    Comparison::Operand b{1, Literal()};
+    Comparison::Operand row_15{-1, Literal(Value("row 15"))};
+    std::vector<uint> col_nums;
+    col_nums.push_back(1);
+    col_nums.push_back(0);
+    ColumnNames projected;
+    projected.push_back("b");
+    projected.push_back("a");
+    Limit plan(new Project(new Filter(new TableScan(table, where), new Comparison(b, Predicate::NE, row_15)),
+                           col_nums, projected), 5, 2);
+    plan.open();
+    std::vector<int32_t> found;
+    while (plan.next(batch))
+        for (uint i = 0; i < batch.size(); i++)
+            if (batch[i].get(0).str() == "row " + std::to_string(batch[i].get_int(1)))
+                found.push_back(batch[i].get_int(1));
+    plan.close();
+    ok = ok && found == std::vector<int32_t>({12, 13, 14, 16, 17});
+    if (!ok)
+        std::cout << "eval plan did not return the right rows" << std::endl;
+    table.drop();
+    return ok;
+}
@@ -0,0 +1,431 @@
+/**
+ * @file eval_plan.h - Physical query plans, executed Volcano style in batches of rows.
+ * RowBatch
+ * EvalPlan
+ * TableScan
+ * TableCount
+ * Filter
+ * Project
+ * Limit
+ * Condition
+ * Comparison
+ * Conjunction
+ * Negation
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+#include "../sql-parser/src/SQLParser.h"
+#include "heap_storage.h"
+
+/**
+ * @class PlanError - exception for queries that cannot be planned (unknown names, unsupported SQL)
+ */
+class PlanError : public std::runtime_error {
+public:
+    explicit PlanError(std::string s) : runtime_error(s) {}
+};
+
+typedef std::unordered_map<Identifier, HeapTable *> Tables;  // the tables a query can name
+
+typedef std::vector<Value> Parameters;  // values of a statement's parameterized literals, in the order of its text
+
+/**
+ * @class Bindings - which literals in a statement's AST are parameters, and where their values are
+ *
+ * Lets a plan be built once and then run again with other values for its literals.
+ */
+struct Bindings {
+    const Parameters *params;
+    std::map<const hsql::Expr *, uint> slots;  // literal (or negated INT literal) -> its index in params
+};
+
+/**
+ * @class Literal - a constant in a plan: either fixed when planned, or one of a statement's Parameters
+ *
+ * A parameter is looked up whenever the literal is used, so the plan sees the values it is run with.
+ */
+class Literal {
+public:
+    Literal() : value(), params(nullptr), index(0) {}
+
+    explicit Literal(const Value &value) : value(value), params(nullptr), index(0) {}
+
+    Literal(const Parameters *params, uint index) : value(), params(params), index(index) {}
+
+    const Value &get() const { return params == nullptr ? value : (*params)[index]; }
+
+protected:
+    Value value;
+    const Parameters *params;
+    uint index;
+};
+
+/**
+ * @class RowBatch - up to CAPACITY rows passed between operators in one call
+ *
+ * The rows are kept when the batch is cleared, so refilling a batch reuses their memory.
+ */
+class RowBatch {
+public:
+    static const uint CAPACITY = 1024;
+
+    RowBatch() : rows(), n(0) {}
+
+    virtual ~RowBatch() {}
+
+    RowBatch(const RowBatch &other) = delete;
+
+    RowBatch(RowBatch &&temp) = delete;
+
+    RowBatch &operator=(const RowBatch &other) = delete;
+
+    RowBatch &operator=(RowBatch &&temp) = delete;
+
+    uint size() const { return n; }
+
+    bool empty() const { return n == 0; }
+
+    bool full() const { return n == CAPACITY; }
+
+    void clear() { n = 0; }
+
+    /**
+     * Add an empty row to the end of the batch
+     * @param column_names  names of the row's columns
+     * @returns             the row, to be filled in (valid until the batch is cleared)
+     */
+    Row &add(const ColumnNames *column_names) {
+        if (n == rows.size())
+            rows.push_back(Row());
+        Row &row = rows[n++];
+        if (row.get_column_names() != column_names)
+            row.set_column_names(column_names);
+        else
+            row.clear();
+        return row;
+    }
+
+    /**
+     * Keep just the first size rows
+     * @param size  new size (no more than the current one)
+     */
+    void truncate(uint size) { n = size; }
+
+    void swap(uint i, uint j) { std::swap(rows[i], rows[j]); }
+
+    Row &operator[](uint i) { return rows[i]; }
+
+    const Row &operator[](uint i) const { return rows[i]; }
+
+protected:
+    Rows rows;
+    uint n;
+};
+
+/**
+ * @class EvalPlan - an operator of a physical plan
+ *
+ *      Plans are trees of operators, each pulling batches of rows from its inputs (Volcano model,
+        but a batch at a time so the virtual calls are paid per batch instead of per row). An
+        operator owns its inputs. Call open() before the first next() and close() when done.
+ */
+class EvalPlan {
+public:
+    EvalPlan() {}
+
+    virtual ~EvalPlan() {}
+
+    EvalPlan(const EvalPlan &other) = delete;
+
+    EvalPlan(EvalPlan &&temp) = delete;
+
+    EvalPlan &operator=(const EvalPlan &other) = delete;
+
+    EvalPlan &operator=(EvalPlan &&temp) = delete;
+
+    virtual void open() = 0;
+
+    /**
+     * Get the next rows
+     * @param batch  cleared, then filled with at least one row (and at most RowBatch::CAPACITY)
+     * @returns      false, with batch empty, when there are no more rows
+     */
+    virtual bool next(RowBatch &batch) = 0;
+
+    virtual void close() = 0;
+
+    virtual const ColumnNames &get_column_names() const = 0;
+
+    virtual const ColumnAttributes &get_column_attributes() const = 0;
+
+    /**
+     * Rough size of the output, for choosing between plans (e.g. a join's build side)
+     * @returns  blocks
+     */
+    virtual u_int64_t estimate_blocks() const = 0;
+
+    /**
+     * Rough memory taken by a copy of a row, for operators that hold rows up to a memory budget
+     * @param row  the row
+     * @returns    bytes
+     */
+    static size_t row_bytes(const Row &row);
+};
+
+/**
+ * @class TableScan - the rows of a HeapTable satisfying some predicates
+ *
+ * With no predicates the table is read block by block through its iterator; otherwise
+ * HeapTable::select finds the rows, so indices and zone maps are used.
+ */
+class TableScan : public EvalPlan {
+public:
+    TableScan(HeapTable &table, Predicates where = Predicates());
+
+    virtual ~TableScan();
+
+    virtual void open();
+
+    virtual bool next(RowBatch &batch);
+
+    virtual void close();
+
+    virtual const ColumnNames &get_column_names() const { return table.get_column_names(); }
+
+    virtual const ColumnAttributes &get_column_attributes() const { return table.get_column_attributes(); }
+
+    virtual u_int64_t estimate_blocks() const { return table.get_block_count(); }
+
+    /**
+     * Add a predicate the rows must satisfy
+     * @param predicate  the predicate (its value is replaced by value's on each open())
+     * @param value      the value to compare with
+     */
+    virtual void add_predicate(const Predicate &predicate, const Literal &value) {
+        where.push_back(predicate);
+        values.push_back(value);
+    }
+
+protected:
+    HeapTable &table;
+    Predicates where;
+    std::vector<Literal> values;    // of the predicates in where
+    HeapTableIterator *rows;
+    Handles *handles;
+    size_t position;    // next of handles
+};
+
+/**
+ * @class TableCount - a single row with the number of rows in a HeapTable in each of its columns
+ *
+ * The plan for SELECT COUNT(*) FROM table: HeapTable::count reads only the blocks' headers.
+ */
+class TableCount : public EvalPlan {
+public:
+    TableCount(HeapTable &table, ColumnNames column_names);
+
+    virtual ~TableCount() {}
+
+    virtual void open();
+
+    virtual bool next(RowBatch &batch);
+
+    virtual void close() { done = true; }
+
+    virtual const ColumnNames &get_column_names() const { return column_names; }
+
+    virtual const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+
+    virtual u_int64_t estimate_blocks() const { return 1; }
+
+protected:
+    HeapTable &table;
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    u_int64_t n;
+    bool done;
+};
+
+/**
+ * @class Condition - boolean expression over the columns of a row
+ */
+class Condition {
+public:
+    Condition() {}
+
+    virtual ~Condition() {}
+
+    Condition(const Condition &other) = delete;
+
+    Condition(Condition &&temp) = delete;
+
+    Condition &operator=(const Condition &other) = delete;
+
+    Condition &operator=(Condition &&temp) = delete;
+
+    virtual bool holds(const Row &row) const = 0;
+};
+
+/**
+ * @class Comparison - compares two operands, each a column or a literal, of the same type
+ *
+ * A comparison with a NULL is false (there is no UNKNOWN, so NOT of it is true).
+ */
+class Comparison : public Condition {
+public:
+    struct Operand {
+        int col_num;    // or -1 for the literal
+        Literal literal;
+    };
+
+    Comparison(Operand left, Predicate::Op op, Operand right) : left(left), op(op), right(right) {}
+
+    virtual bool holds(const Row &row) const {
+        if ((left.col_num >= 0 && row.is_null((uint) left.col_num))
+            || (right.col_num >= 0 && row.is_null((uint) right.col_num)))
+            return false;
+        ValueView left_value = left.col_num < 0 ? ValueView(left.literal.get()) : row.get((uint) left.col_num);
+        ValueView right_value = right.col_num < 0 ? ValueView(right.literal.get()) : row.get((uint) right.col_num);
+        return Predicate::holds(op, left_value.compare(right_value));
+    }
+
+protected:
+    Operand left;
+    Predicate::Op op;
+    Operand right;
+};
+
+/**
+ * @class Conjunction - AND or OR of conditions (owned)
+ */
+class Conjunction : public Condition {
+public:
+    Conjunction(bool is_and, std::vector<Condition *> terms) : is_and(is_and), terms(terms) {}
+
+    virtual ~Conjunction() {
+        for (Condition *term : terms)
+            delete term;
+    }
+
+    virtual bool holds(const Row &row) const {
+        for (Condition *term : terms)
+            if (term->holds(row) != is_and)
+                return !is_and;
+        return is_and;
+    }
+
+protected:
+    bool is_and;
+    std::vector<Condition *> terms;
+};
+
+/**
+ * @class Negation - NOT of a condition (owned)
+ */
+class Negation : public Condition {
+public:
+    Negation(Condition *term) : term(term) {}
+
+    virtual ~Negation() { delete term; }
+
+    virtual bool holds(const Row &row) const { return !term->holds(row); }
+
+protected:
+    Condition *term;
+};
+
+/**
+ * @class Filter - the rows of its input satisfying a condition
+ */
+class Filter : public EvalPlan {
+public:
+    Filter(EvalPlan *input, Condition *condition) : input(input), condition(condition) {}
+
+    virtual ~Filter();
+
+    virtual void open() { input->open(); }
+
+    virtual bool next(RowBatch &batch);
+
+    virtual void close() { input->close(); }
+
+    virtual const ColumnNames &get_column_names() const { return input->get_column_names(); }
+
+    virtual const ColumnAttributes &get_column_attributes() const { return input->get_column_attributes(); }
+
+    virtual u_int64_t estimate_blocks() const { return input->estimate_blocks(); }
+
+protected:
+    EvalPlan *input;
+    Condition *condition;
+};
+
+/**
+ * @class Project - some of the columns of its input, possibly renamed
+ */
+class Project : public EvalPlan {
+public:
+    Project(EvalPlan *input, std::vector<uint> col_nums, ColumnNames column_names);
+
+    virtual ~Project() { delete input; }
+
+    virtual void open() { input->open(); }
+
+    virtual bool next(RowBatch &batch);
+
+    virtual void close() { input->close(); }
+
+    virtual const ColumnNames &get_column_names() const { return column_names; }
+
+    virtual const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+
+    virtual u_int64_t estimate_blocks() const { return input->estimate_blocks(); }
+
+protected:
+    EvalPlan *input;
+    std::vector<uint> col_nums;     // input column of each output column
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    RowBatch input_batch;
+};
+
+/**
+ * @class Limit - at most limit rows of its input, after skipping offset of them
+ *
+ * Stops pulling from its input as soon as it has passed on limit rows.
+ */
+class Limit : public EvalPlan {
+public:
+    Limit(EvalPlan *input, u_int64_t limit, u_int64_t offset = 0) : input(input), limit(limit), offset(offset),
+                                                                    skipped(0), returned(0) {}
+
+    virtual ~Limit() { delete input; }
+
+    virtual void open();
+
+    virtual bool next(RowBatch &batch);
+
+    virtual void close() { input->close(); }
+
+    virtual const ColumnNames &get_column_names() const { return input->get_column_names(); }
+
+    virtual const ColumnAttributes &get_column_attributes() const { return input->get_column_attributes(); }
+
+    virtual u_int64_t estimate_blocks() const { return input->estimate_blocks(); }
+
+protected:
+    EvalPlan *input;
+    u_int64_t limit;
+    u_int64_t offset;
+    u_int64_t skipped;
+    u_int64_t returned;
+};
+
+EvalPlan *plan_select(const hsql::SelectStatement *select, const Tables &tables, const Bindings *bindings = nullptr);
+
+bool test_eval_plan();
@@ -0,0 +1,435 @@
+#include "hash_aggregate.h"
+#include "hash_index.h"
+#include <map>
+
+/**
+ * @class HashAggregate
+ *
+ * Groups its input's rows in an open-addressing hash table, partitioning new groups to disk if the
+ * groups do not fit in memory.
+ */
+
+/**
+ * Hash a normalized group key
+ * @param key the key
+ * @return its hash
+ */
+static u_int32_t key_hash(const std::string &key) {
+    ValueView bytes;
+    bytes.data_type = ColumnAttribute::TEXT;
+    bytes.s = key.data();
+    bytes.s_size = (u_int32_t) key.size();
+    return HashIndex::hash(bytes);
+}
+
+/**
+ * @param input the rows to aggregate (owned)
+ * @param group_col_nums the input columns to group by (none for a single group of all the rows)
+ * @param aggregates the aggregates (SUM and AVG of INT columns only)
+ * @param column_names a name for each group column, then each aggregate
+ * @param memory_budget bytes of groups to hold in memory before partitioning
+ */
+HashAggregate::HashAggregate(EvalPlan *input, std::vector<uint> group_col_nums, Aggregates aggregates,
+                             ColumnNames column_names, size_t memory_budget) : input(input),
+            group_col_nums(group_col_nums), aggregates(aggregates), group_keys(), memory_budget(memory_budget),
+            column_names(column_names), column_attributes(), group_names(), keys(), hashes(), group_rows(),
+            states(), slots(), group_bytes(0), key(), level(0), spilled(), pending(), position(0),
+            partitions_made(0) {
+    for (uint i = 0; i < group_col_nums.size(); i++) {
+        group_keys.push_back(Sort::SortKey{group_col_nums[i], false});
+        group_names.push_back(column_names[i]);
+        column_attributes.push_back(input->get_column_attributes()[group_col_nums[i]]);
+    }
+    for (const Aggregate &aggregate : aggregates) {
+        if (aggregate.function == MIN || aggregate.function == MAX)
+            column_attributes.push_back(input->get_column_attributes()[aggregate.col_num]);
+        else
+            column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    }
+}
+
+HashAggregate::~HashAggregate() {
+    clear();
+    delete input;
+}
+
+/**
+ * Aggregate all of the input (spilling the rows of the groups that do not fit)
+ */
+void HashAggregate::open() {
+    clear();
+    partitions_made = 0;
+    input->open();
+    RowBatch batch;
+    while (input->next(batch))
+        for (uint i = 0; i < batch.size(); i++)
+            consume(batch[i]);
+    if (group_col_nums.empty() && keys.empty()) {
+        key.clear();
+        add_group(Row(&input->get_column_names()), key_hash(key));
+    }
+    finish_pass();
+}
+
+/**
+ * Get the next groups
+ * @param batch filled with the next groups' rows
+ * @return false when there are no more
+ */
+bool HashAggregate::next(RowBatch &batch) {
+    batch.clear();
+    while (!batch.full()) {
+        if (position < keys.size())
+            emit(batch, (uint) position++);
+        else if (!next_partition())
+            break;
+    }
+    return !batch.empty();
+}
+
+void HashAggregate::close() {
+    input->close();
+    clear();
+}
+
+/**
+ * Aggregate a row into its group, making the group if there is room for it and spilling the row
+ * if not
+ * @param row a row of the input
+ */
+void HashAggregate::consume(const Row &row) {
+    Sort::normalize(row, group_keys, key);
+    u_int32_t hash = key_hash(key);
+    uint group;
+    if (!find(hash, group)) {
+        if (group_bytes > memory_budget && level < 32 / PARTITION_BITS) {
+            spill(row, hash);
+            return;
+        }
+        group = add_group(row, hash);
+    }
+    update(group, row);
+}
+
+/**
+ * Look for the group with the key of the row being aggregated
+ * @param hash the key's hash
+ * @param group set to the group's number, if it is found
+ * @return false if there is no such group
+ */
+bool HashAggregate::find(u_int32_t hash, uint &group) const {
+    if (slots.empty())
+        return false;
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask; slots[i] != 0; i = (i + 1) & mask) {
+        uint candidate = slots[i] - 1;
+        if (hashes[candidate] == hash && keys[candidate] == key) {
+            group = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Make a group for the key of the row being aggregated, with nothing aggregated into it yet
+ * @param row the row (for its group column values)
+ * @param hash the key's hash
+ * @return the group's number
+ */
+uint HashAggregate::add_group(const Row &row, u_int32_t hash) {
+    uint group = (uint) keys.size();
+    keys.push_back(key);
+    hashes.push_back(hash);
+    group_rows.push_back(Row(&group_names));
+    for (uint i = 0; i < group_col_nums.size(); i++)
+        group_rows.back().set(i, row, group_col_nums[i]);
+    states.resize(states.size() + aggregates.size(), AggregateState{0, 0, std::string()});
+    group_bytes += key.size() + row_bytes(group_rows.back()) + aggregates.size() * sizeof(AggregateState);
+
+    if (keys.size() * 2 > slots.size()) {
+        // keep the table at most half full
+        slots.assign(std::max((size_t) 16, slots.size() * 2), 0);
+        for (uint g = 0; g < keys.size(); g++)
+            insert_slot(g);
+    } else {
+        insert_slot(group);
+    }
+    return group;
+}
+
+/**
+ * Put a group's number in the first empty slot at or after its hash's
+ * @param group the group
+ */
+void HashAggregate::insert_slot(uint group) {
+    size_t mask = slots.size() - 1;
+    size_t i = hashes[group] & mask;
+    while (slots[i] != 0)
+        i = (i + 1) & mask;
+    slots[i] = group + 1;
+}
+
+/**
+ * Aggregate a row into a group
+ * @param group the group
+ * @param row the row
+ */
+void HashAggregate::update(uint group, const Row &row) {
+    AggregateState *state = &states[group * aggregates.size()];
+    for (const Aggregate &aggregate : aggregates) {
+        AggregateState &s = *state++;
+        if (aggregate.function == COUNT_STAR) {
+            s.count++;
+            continue;
+        }
+        if (row.is_null(aggregate.col_num))
+            continue;
+        ValueView value = row.get(aggregate.col_num);
+        switch (aggregate.function) {
+            case SUM:
+            case AVG:
+                s.value += value.n;
+                break;
+            case MIN:
+            case MAX:
+                if (value.data_type == ColumnAttribute::INT) {
+                    if (s.count == 0 || (aggregate.function == MIN ? value.n < s.value : value.n > s.value))
+                        s.value = value.n;
+                } else {
+                    ValueView so_far;
+                    so_far.data_type = ColumnAttribute::TEXT;
+                    so_far.s = s.text.data();
+                    so_far.s_size = (u_int32_t) s.text.size();
+                    int cmp = value.compare(so_far);
+                    if (s.count == 0 || (aggregate.function == MIN ? cmp < 0 : cmp > 0))
+                        s.text.assign(value.s, value.s_size);
+                }
+                break;
+            default:
+                break;
+        }
+        s.count++;
+    }
+}
+
+/**
+ * Add a group's row to the batch
+ * @param batch the batch (not full)
+ * @param group the group
+ * @throws DbRelationError if a COUNT, SUM or AVG does not fit in an INT
+ */
+void HashAggregate::emit(RowBatch &batch, uint group) {
+    Row &out = batch.add(&column_names);
+    uint n_groups = (uint) group_col_nums.size();
+    for (uint i = 0; i < n_groups; i++)
+        out.set(i, group_rows[group], i);
+    const AggregateState *state = &states[group * aggregates.size()];
+    for (uint i = 0; i < aggregates.size(); i++) {
+        const AggregateState &s = state[i];
+        uint col_num = n_groups + i;
+        int64_t n;
+        switch (aggregates[i].function) {
+            case COUNT_STAR:
+            case COUNT:
+                n = s.count;
+                break;
+            case SUM:
+                n = s.value;
+                break;
+            case AVG:
+                n = s.count == 0 ? 0 : s.value / s.count;
+                break;
+            default:
+                n = s.value;
+                break;
+        }
+        if (s.count == 0 && aggregates[i].function != COUNT_STAR && aggregates[i].function != COUNT)
+            out.set_null(col_num, column_attributes[col_num].get_data_type());
+        else if (column_attributes[col_num].get_data_type() == ColumnAttribute::TEXT)
+            out.set(col_num, s.text);
+        else if (n < INT32_MIN || n > INT32_MAX)
+            throw DbRelationError(column_names[col_num] + " is out of range for INT");
+        else
+            out.set(col_num, (int32_t) n);
+    }
+}
+
+/**
+ * Write a row of a group that did not fit to the partition its hash picks
+ * @param row the row
+ * @param hash its key's hash
+ */
+void HashAggregate::spill(const Row &row, u_int32_t hash) {
+    if (spilled.empty()) {
+        for (uint p = 0; p < PARTITIONS; p++)
+            spilled.push_back(new SpillFile(input->get_column_attributes()));
+        partitions_made += PARTITIONS;
+    }
+    uint p = (hash >> (32 - PARTITION_BITS * (level + 1))) & (PARTITIONS - 1); // top bits first; slots use the bottom
+    spilled[p]->append(row);
+}
+
+/**
+ * Queue up the partitions the rows just aggregated spilled into
+ */
+void HashAggregate::finish_pass(void) {
+    for (SpillFile *rows : spilled) {
+        if (rows->size() == 0) {
+            delete rows;
+            continue;
+        }
+        rows->rewind();
+        pending.push_back(Partition{rows, level + 1});
+    }
+    spilled.clear();
+}
+
+/**
+ * Aggregate the next partition in place of the groups returned so far
+ * @return false if there are no more partitions
+ */
+bool HashAggregate::next_partition(void) {
+    if (pending.empty())
+        return false;
+    clear_groups();
+    Partition partition = pending.front();
+    pending.pop_front();
+    level = partition.level;
+    try {
+        Row row(&input->get_column_names());
+        while (partition.rows->next(row))
+            consume(row);
+    } catch (...) {
+        delete partition.rows;
+        throw;
+    }
+    delete partition.rows;
+    finish_pass();
+    return true;
+}
+
+/**
+ * Drop the groups in memory
+ */
+void HashAggregate::clear_groups(void) {
+    keys.clear();
+    hashes.clear();
+    group_rows.clear();
+    states.clear();
+    slots.clear();
+    group_bytes = 0;
+    position = 0;
+}
+
+/**
+ * Drop the groups and all partitions
+ */
+void HashAggregate::clear(void) {
+    clear_groups();
+    level = 0;
+    for (SpillFile *rows : spilled)
+        delete rows;
+    spilled.clear();
+    for (Partition &partition : pending)
+        delete partition.rows;
+    pending.clear();
+}
+
+/**
+ * What a group of the test table should aggregate to
+ */
+struct ExpectedGroup {
+    int count;
+    int64_t sum;
+    int min;
+    int max;
+    std::string min_label;
+};
+
+/**
+ * Check a HashAggregate of the test table, grouped by region, against the expected groups
+ */
+static bool check_groups(HashAggregate &aggregate, const std::map<std::string, ExpectedGroup> &expected) {
+    std::map<std::string, ExpectedGroup> found;
+    bool ok = true;
+    RowBatch batch;
+    aggregate.open();
+    while (aggregate.next(batch)) {
+        for (uint i = 0; i < batch.size(); i++) {
+            std::string region = batch[i].get(0).str();
+            auto it = expected.find(region);
+            if (found.count(region) > 0 || it == expected.end()) {
+                ok = false;
+                continue;
+            }
+            const ExpectedGroup &e = it->second;
+            ok = ok && batch[i].get_int(1) == e.count && batch[i].get_int(2) == e.sum && batch[i].get_int(3) == e.min
+                 && batch[i].get_int(4) == e.max && batch[i].get_int(5) == (int) (e.sum / e.count)
+                 && batch[i].get(6).str() == e.min_label;
+            found[region] = e;
+        }
+    }
+    aggregate.close();
+    return ok && found.size() == expected.size();
+}
+
+bool test_hash_aggregate() {
+    ColumnNames column_names;
+    column_names.push_back("region");
+    column_names.push_back("amount");
+    column_names.push_back("label");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_hash_aggregate_cpp", column_names, column_attributes);
+    table.create();
+    Rows rows(5000, Row(&column_names));
+    std::map<std::string, ExpectedGroup> expected;
+    for (int i = 0; i < 5000; i++) {
+        std::string region = "region " + std::to_string(i * 31 % 600);
+        int amount = i % 97 - 40;
+        std::string label = "label " + std::to_string(i % 1000);
+        rows[i].set(0, region);
+        rows[i].set(1, amount);
+        rows[i].set(2, label);
+        auto it = expected.find(region);
+        if (it == expected.end()) {
+            expected[region] = ExpectedGroup{1, amount, amount, amount, label};
+        } else {
+            ExpectedGroup &e = it->second;
+            e.count++;
+            e.sum += amount;
+            e.min = std::min(e.min, amount);
+            e.max = std::max(e.max, amount);
+            e.min_label = std::min(e.min_label, label);
+        }
+    }
+    delete table.insert_batch(rows);
+
+    HashAggregate::Aggregates aggregates{
+            {HashAggregate::COUNT_STAR, 0}, {HashAggregate::SUM, 1}, {HashAggregate::MIN, 1}, {HashAggregate::MAX, 1},
+            {HashAggregate::AVG, 1}, {HashAggregate::MIN, 2}};
+    ColumnNames names{"region", "count", "sum", "min", "max", "avg", "min_label"};
+    HashAggregate in_memory(new TableScan(table), std::vector<uint>{0}, aggregates, names);
+    bool ok = check_groups(in_memory, expected) && in_memory.get_partition_count() == 0;
+    HashAggregate partitioned(new TableScan(table), std::vector<uint>{0}, aggregates, names, 2048);
+    ok = ok && check_groups(partitioned, expected) && partitioned.get_partition_count() > HashAggregate::PARTITIONS;
+
+    // no groups: one row, even with no input; aggregates of nothing are NULL except COUNT
+    Predicates nothing{Predicate("amount", Predicate::GT, Value(1000))};
+    HashAggregate total(new TableScan(table, nothing), std::vector<uint>(),
+                        HashAggregate::Aggregates{{HashAggregate::COUNT_STAR, 0}, {HashAggregate::COUNT, 1},
+                                                  {HashAggregate::MAX, 2}}, ColumnNames{"count", "n", "max"});
+    RowBatch batch;
+    total.open();
+    ok = ok && total.next(batch) && batch.size() == 1 && batch[0].get_int(0) == 0 && batch[0].get_int(1) == 0
+         && batch[0].is_null(2) && !total.next(batch);
+    total.close();
+
+    if (!ok)
+        std::cout << "hash aggregate did not return the right groups" << std::endl;
+    table.drop();
+    return ok;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file hash_aggregate.h - GROUP BY and aggregate functions, with a hash table that partitions to disk.
+ * HashAggregate
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include "eval_plan.h"
+#include "sort.h"
+#include "spill_file.h"
+#include <deque>
+
+/**
+ * @class HashAggregate - one row per group of its input's rows, with aggregates of each group
+ *
+ *      The output is the group columns followed by the aggregates. COUNT and SUM are INT, as is
+        AVG (the engine has no fractional type, so it is rounded toward zero); MIN and MAX have the
+        type of their column. NULLs are skipped, so an aggregate of nothing but NULLs is NULL (and
+        COUNT 0). With no group columns there is exactly one output row, even for no input.
+
+        Groups are found with an open-addressing (linear probing) table of group numbers. Each
+        group's key is its group columns normalized as Sort does, so it is one memcmp to compare,
+        and its aggregate states are kept inline in one array, AggregateState per aggregate.
+
+        Once the groups take memory_budget bytes, rows of groups already in the table are still
+        aggregated in place, but rows of new groups are written by hash to PARTITIONS SpillFiles.
+        After the in-memory groups are returned, each partition is aggregated the same way in turn
+        (with the next bits of the hash, should it need partitioning again).
+ */
+class HashAggregate : public EvalPlan {
+public:
+    enum Function {
+        COUNT_STAR, COUNT, SUM, MIN, MAX, AVG
+    };
+
+    struct Aggregate {
+        Function function;
+        uint col_num;           // not used for COUNT_STAR
+    };
+    typedef std::vector<Aggregate> Aggregates;
+
+    static const uint PARTITION_BITS = 4;
+    static const uint PARTITIONS = 1 << PARTITION_BITS;
+    static const size_t DEFAULT_MEMORY = 64 * 1024 * 1024;
+
+    HashAggregate(EvalPlan *input, std::vector<uint> group_col_nums, Aggregates aggregates,
+                  ColumnNames column_names, size_t memory_budget = DEFAULT_MEMORY);
+
+    virtual ~HashAggregate();
+
+    virtual void open();
+
+    virtual bool next(RowBatch &batch);
+
+    virtual void close();
+
+    virtual const ColumnNames &get_column_names() const { return column_names; }
+
+    virtual const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+
+    virtual u_int64_t estimate_blocks() const { return input->estimate_blocks(); }
+
+    virtual uint get_partition_count() const { return partitions_made; }
+
+protected:
+    struct AggregateState {
+        int64_t count;          // non-NULL values seen
+        int64_t value;          // SUM/AVG: their sum, MIN/MAX of INT: the value so far
+        std::string text;       // MIN/MAX of TEXT: the value so far
+    };
+
+    /**
+     * @class Partition - input rows spilled to a SpillFile, and how many times they have been split
+     */
+    struct Partition {
+        SpillFile *rows;
+        uint level;
+    };
+
+    EvalPlan *input;
+    std::vector<uint> group_col_nums;
+    Aggregates aggregates;
+    Sort::SortKeys group_keys;
+    size_t memory_budget;
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    ColumnNames group_names;
+
+    // group g has key keys[g] (hashing to hashes[g]), group column values group_rows[g] and the
+    // states of its aggregates at states[g * aggregates.size()] on
+    std::vector<std::string> keys;
+    std::vector<u_int32_t> hashes;
+    Rows group_rows;
+    std::vector<AggregateState> states;
+    std::vector<u_int32_t> slots;   // open-addressing table of group numbers + 1 (0 for an empty slot)
+    size_t group_bytes;
+    std::string key;                // of the row being aggregated
+
+    uint level;                     // times the rows being aggregated have been split (picks the hash bits)
+    std::vector<SpillFile *> spilled;   // where the rows of new groups go once memory is full
+    std::deque<Partition> pending;      // partitions still to be aggregated
+    size_t position;                // next of the groups to return
+    uint partitions_made;
+
+    virtual void consume(const Row &row);
+
+    virtual bool find(u_int32_t hash, uint &group) const;
+
+    virtual uint add_group(const Row &row, u_int32_t hash);
+
+    virtual void insert_slot(uint group);
+
+    virtual void update(uint group, const Row &row);
+
+    virtual void emit(RowBatch &batch, uint group);
+
+    virtual void spill(const Row &row, u_int32_t hash);
+
+    virtual void finish_pass(void);
+
+    virtual bool next_partition(void);
+
+    virtual void clear_groups(void);
+
+    virtual void clear(void);
+};
+
+bool test_hash_aggregate();
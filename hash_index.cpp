@@ -0,0 +1,502 @@
+#include "hash_index.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_set>
+
+/**
+ * @class HashIndex
+ *
+ * Linear hash table of (hash, handle) entries, with fixed-position primary pages and chained overflow pages.
+ */
+
+/**
+ * Set up an index (use create() or open() before using it)
+ * @param relation the indexed table
+ * @param name the index's name (its files are named after the table and the index)
+ * @param key_columns the key column, which must be a single column of relation
+ * @param unique whether to refuse a second row with the same key
+ * @throws DbRelationError if the key is not a single column of the table
+ */
+HashIndex::HashIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique) :
+            DbIndex(relation, name, key_columns, unique), file(relation.get_table_name() + "-" + name),
+            overflow_file(relation.get_table_name() + "-" + name + "-overflow"), pool(file),
+            overflow_pool(overflow_file), key_column(0), meta(), closed(true) {
+    if (key_columns.size() != 1)
+        throw DbRelationError("HASH index must have exactly one key column");
+    const ColumnNames &column_names = relation.get_column_names();
+    ColumnNames::const_iterator column = std::find(column_names.begin(), column_names.end(), key_columns[0]);
+    if (column == column_names.end())
+        throw DbRelationError("No such column " + key_columns[0]);
+    key_column = (uint) (column - column_names.begin());
+}
+
+/**
+ * Create the index files and add every row in the table, with enough buckets up front that none
+ * need splitting yet
+ * @throws DbRelationError if the index is unique but the table has duplicate keys
+ */
+void HashIndex::create() {
+    file.create(); // block 1 is for the Meta; block 1 of the overflow file is never used
+    overflow_file.create();
+    closed = false;
+
+    std::vector<Entry> all;
+    std::unordered_set<std::string> seen;
+    DbRelationIterator *rows = relation.scan();
+    while (rows->next()) {
+        Handle handle = rows->get_handle();
+        const ValueView &key = rows->get_row_view()[key_column];
+        if (unique && !seen.insert(key.data_type == ColumnAttribute::INT ? std::to_string(key.n) : key.str()).second) {
+            delete rows;
+            drop();
+            throw DbRelationError("Duplicate key in unique index " + name);
+        }
+        Entry entry = {hash(key), handle.first, handle.second};
+        all.push_back(entry);
+    }
+    delete rows;
+
+    meta.initial_buckets = std::max((u_int32_t) MIN_BUCKETS,
+                                    (u_int32_t) std::ceil(all.size() / (SPLIT_FILL * PAGE_CAPACITY)));
+    meta.level = 0;
+    meta.split = 0;
+    meta.n_buckets = meta.initial_buckets;
+    meta.n_entries = all.size();
+    meta.free_overflow = 0;
+    for (u_int32_t b = 0; b < meta.n_buckets; b++) {
+        SlottedPage *page = pool.pin_new();
+        Header *h = header(page);
+        h->size = 0;
+        h->overflow = 0;
+        pool.unpin(page, true);
+    }
+    for (const Entry &entry : all)
+        add(bucket(entry.hash), entry);
+    write_meta();
+}
+
+/**
+ * Remove the index files
+ */
+void HashIndex::drop() {
+    pool.discard();
+    overflow_pool.discard();
+    file.drop();
+    overflow_file.drop();
+    closed = true;
+}
+
+/**
+ * Open the index files and read the Meta
+ */
+void HashIndex::open() {
+    if (!closed)
+        return;
+    file.open();
+    overflow_file.open();
+    closed = false;
+    SlottedPage *page = pool.pin(1);
+    memcpy(&meta, page->get_data(), sizeof(meta));
+    pool.unpin(page);
+}
+
+/**
+ * Write back any changed pages and close the index files
+ */
+void HashIndex::close() {
+    if (closed)
+        return;
+    pool.flush();
+    pool.discard();
+    overflow_pool.flush();
+    overflow_pool.discard();
+    file.close();
+    overflow_file.close();
+    closed = true;
+}
+
+/**
+ * Find the rows with a given key (and possibly a few whose keys hash the same)
+ * @param key_values dictionary holding the key column's value
+ * @return handles of the rows (freed by caller)
+ * @throws DbRelationError if the key is missing
+ */
+Handles *HashIndex::lookup(const ValueDict *key_values) {
+    open();
+    ValueDict::const_iterator entry = key_values->find(key_columns[0]);
+    if (entry == key_values->end())
+        throw DbRelationError("HASH index lookup needs a value for " + key_columns[0]);
+    ValueView key;
+    key.data_type = entry->second.data_type;
+    key.n = entry->second.n;
+    key.s = entry->second.s.data();
+    key.s_size = (u_int32_t) entry->second.s.size();
+    Handles *handles = new Handles();
+    find(hash(key), handles);
+    return handles;
+}
+
+/**
+ * Add a row, splitting a bucket if the table has become too full
+ * @param handle the row's handle
+ * @param row the row's values, in the table's column order
+ * @throws DbRelationError if the index is unique and another row has the same key
+ */
+void HashIndex::insert(Handle handle, const Row &row) {
+    open();
+    ValueView key = row.get(key_column);
+    Entry entry = {hash(key), handle.first, handle.second};
+    if (unique) {
+        Handles candidates;
+        find(entry.hash, &candidates);
+        Row other(&key_columns);
+        for (Handle candidate : candidates) {
+            if (candidate == handle)
+                continue;
+            relation.project(candidate, other);
+            ValueView other_key = other.get(0);
+            if (other_key.n == key.n && other_key.s_size == key.s_size
+                && (key.s_size == 0 || memcmp(other_key.s, key.s, key.s_size) == 0))
+                throw DbRelationError("Duplicate key in unique index " + name);
+        }
+    }
+    add(bucket(entry.hash), entry);
+    meta.n_entries++;
+    if (meta.n_entries > SPLIT_FILL * PAGE_CAPACITY * meta.n_buckets)
+        split();
+    write_meta();
+}
+
+/**
+ * Remove a row's entry, if it is there
+ * @param handle the row's handle
+ * @param row the row's values when it was indexed, in the table's column order
+ */
+void HashIndex::del(Handle handle, const Row &row) {
+    open();
+    Entry entry = {hash(row.get(key_column)), handle.first, handle.second};
+    if (remove(bucket(entry.hash), entry)) {
+        meta.n_entries--;
+        write_meta();
+    }
+}
+
+/**
+ * Re-index a row only if its key changed
+ * @param handle the row's handle
+ * @param old_row the row's values when it was indexed
+ * @param new_row the row's values now
+ */
+void HashIndex::update(Handle handle, const Row &old_row, const Row &new_row) {
+    ValueView old_key = old_row.get(key_column);
+    ValueView new_key = new_row.get(key_column);
+    if (old_key.n != new_key.n || old_key.s_size != new_key.s_size
+        || (old_key.s_size > 0 && memcmp(old_key.s, new_key.s, old_key.s_size) != 0))
+        DbIndex::update(handle, old_row, new_row);
+}
+
+/**
+ * Hash a key: FNV-1a over its bytes, then a final mix so the low bits (used to pick buckets) depend
+ * on every byte
+ * @param key an INT or TEXT value
+ * @return the hash
+ */
+u_int32_t HashIndex::hash(const ValueView &key) {
+    const unsigned char *bytes = key.data_type == ColumnAttribute::INT ? (const unsigned char *) &key.n
+                                                                       : (const unsigned char *) key.s;
+    size_t size = key.data_type == ColumnAttribute::INT ? sizeof(key.n) : key.s_size;
+    u_int32_t h = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        h ^= bytes[i];
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * Which bucket a hash belongs in: buckets before the split pointer have already been split, so they
+ * use the next level's modulus
+ * @param hash the key's hash
+ * @return the bucket number
+ */
+u_int32_t HashIndex::bucket(u_int32_t hash) const {
+    u_int32_t n = meta.initial_buckets << meta.level;
+    u_int32_t b = hash % n;
+    if (b < meta.split)
+        b = hash % (n * 2);
+    return b;
+}
+
+/**
+ * Add the handles of every entry with a hash, following the bucket's overflow chain
+ * @param hash the key's hash
+ * @param handles where to put the handles
+ */
+void HashIndex::find(u_int32_t hash, Handles *handles) {
+    BufferPool *page_pool = &pool;
+    SlottedPage *page = pool.pin(bucket(hash) + 2);
+    while (true) {
+        Header *h = header(page);
+        Entry *page_entries = entries(page);
+        for (uint i = 0; i < h->size; i++)
+            if (page_entries[i].hash == hash)
+                handles->push_back(Handle(page_entries[i].block_id, page_entries[i].record_id));
+        BlockID next = h->overflow;
+        page_pool->unpin(page);
+        if (next == 0)
+            return;
+        page_pool = &overflow_pool;
+        page = overflow_pool.pin(next);
+    }
+}
+
+/**
+ * Put an entry in the first page of a bucket with room, chaining a new overflow page if none has
+ * @param bucket the bucket number
+ * @param entry the entry
+ */
+void HashIndex::add(u_int32_t bucket, const Entry &entry) {
+    BufferPool *page_pool = &pool;
+    SlottedPage *page = pool.pin(bucket + 2);
+    while (true) {
+        Header *h = header(page);
+        if (h->size < PAGE_CAPACITY) {
+            entries(page)[h->size++] = entry;
+            page_pool->unpin(page, true);
+            return;
+        }
+        bool dirty = false;
+        if (h->overflow == 0) {
+            SlottedPage *overflow = new_overflow_page();
+            h->overflow = overflow->get_block_id();
+            overflow_pool.unpin(overflow, true);
+            dirty = true;
+        }
+        BlockID next = h->overflow;
+        page_pool->unpin(page, dirty);
+        page_pool = &overflow_pool;
+        page = overflow_pool.pin(next);
+    }
+}
+
+/**
+ * Take an entry out of a bucket, filling its place with the last entry of the same page
+ * @param bucket the bucket number
+ * @param entry the entry (matched on hash and handle)
+ * @return false if it was not there
+ */
+bool HashIndex::remove(u_int32_t bucket, const Entry &entry) {
+    BufferPool *page_pool = &pool;
+    SlottedPage *page = pool.pin(bucket + 2);
+    while (true) {
+        Header *h = header(page);
+        Entry *page_entries = entries(page);
+        for (uint i = 0; i < h->size; i++) {
+            if (page_entries[i].hash == entry.hash && page_entries[i].block_id == entry.block_id
+                && page_entries[i].record_id == entry.record_id) {
+                page_entries[i] = page_entries[--h->size];
+                page_pool->unpin(page, true);
+                return true;
+            }
+        }
+        BlockID next = h->overflow;
+        page_pool->unpin(page);
+        if (next == 0)
+            return false;
+        page_pool = &overflow_pool;
+        page = overflow_pool.pin(next);
+    }
+}
+
+/**
+ * Split the bucket at the split pointer: add a new bucket at the end and move over the entries that
+ * the next level's modulus sends there
+ */
+void HashIndex::split(void) {
+    u_int32_t n = meta.initial_buckets << meta.level;
+    u_int32_t old_bucket = meta.split;
+
+    SlottedPage *page = pool.pin_new();
+    if (page->get_block_id() != meta.n_buckets + 2) {
+        pool.unpin(page);
+        throw DbRelationError("hash index " + name + " has lost track of its buckets");
+    }
+    header(page)->size = 0;
+    header(page)->overflow = 0;
+    pool.unpin(page, true);
+    meta.n_buckets++;
+
+    // empty the old bucket, putting its overflow pages on the free list
+    std::vector<Entry> moved;
+    page = pool.pin(old_bucket + 2);
+    moved.insert(moved.end(), entries(page), entries(page) + header(page)->size);
+    BlockID next = header(page)->overflow;
+    header(page)->size = 0;
+    header(page)->overflow = 0;
+    pool.unpin(page, true);
+    while (next != 0) {
+        page = overflow_pool.pin(next);
+        moved.insert(moved.end(), entries(page), entries(page) + header(page)->size);
+        BlockID after = header(page)->overflow;
+        header(page)->size = 0;
+        header(page)->overflow = meta.free_overflow;
+        meta.free_overflow = next;
+        overflow_pool.unpin(page, true);
+        next = after;
+    }
+
+    meta.split++;
+    if (meta.split == n) {
+        meta.level++;
+        meta.split = 0;
+    }
+    for (const Entry &entry : moved)
+        add(bucket(entry.hash), entry);
+}
+
+/**
+ * Get an empty overflow page, from the free list if there is one
+ * @return the page, pinned in the overflow pool (the caller unpins it)
+ */
+SlottedPage *HashIndex::new_overflow_page(void) {
+    SlottedPage *page;
+    if (meta.free_overflow != 0) {
+        page = overflow_pool.pin(meta.free_overflow);
+        meta.free_overflow = header(page)->overflow;
+    } else {
+        page = overflow_pool.pin_new();
+    }
+    header(page)->size = 0;
+    header(page)->overflow = 0;
+    return page;
+}
+
+/**
+ * Save the Meta in block 1
+ */
+void HashIndex::write_meta(void) {
+    SlottedPage *page = pool.pin(1);
+    memcpy(page->get_data(), &meta, sizeof(meta));
+    pool.unpin(page, true);
+}
+
+bool test_hash_index() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_hash_index_cpp", column_names, column_attributes);
+    table.create();
+
+    Rows rows(20000, Row(&table.get_column_names()));
+    for (uint i = 0; i < rows.size(); i++) {
+        rows[i].set(0, (int32_t) i);
+        rows[i].set(1, "name" + std::to_string(i % 5000));
+    }
+    delete table.insert_batch(rows);
+    ColumnNames key(1, "b");
+    HashIndex index(table, "hx", key);
+    index.create();
+    table.add_index(&index);
+    u_int32_t buckets = index.get_bucket_count();
+    delete table.insert_batch(rows); // enough to split buckets
+
+    bool ok = index.get_bucket_count() > buckets;
+    ValueDict where;
+    where["b"] = Value("name42");
+    Handles *handles = table.select(&where);
+    ok = ok && handles->size() == 8;
+    Row row(&table.get_column_names());
+    for (Handle handle : *handles) {
+        table.project(handle, row);
+        ok = ok && row.get(1).str() == "name42";
+    }
+    Handle moved = (*handles)[0];
+    delete handles;
+
+    ValueDict change;
+    change["b"] = Value("renamed");
+    table.update(moved, &change);
+    index.close();
+    index.open();
+    handles = index.lookup(&where);
+    ok = ok && handles->size() == 7;
+    delete handles;
+    where["b"] = Value("renamed");
+    handles = table.select(&where);
+    ok = ok && handles->size() == 1 && (*handles)[0] == moved;
+    delete handles;
+    if (!ok)
+        std::cout << "hash index did not find the right rows" << std::endl;
+
+    table.remove_index(&index);
+    index.drop();
+    table.drop();
+
+    // a unique index projects the rows already in a key's bucket, which a batch may still be filling
+    HeapTable unique_table("_test_hash_index_unique_cpp", column_names, column_attributes);
+    unique_table.create();
+    HashIndex unique(unique_table, "ux", ColumnNames(1, "a"), true);
+    unique.create();
+    unique_table.add_index(&unique);
+    Rows some(200, Row(&unique_table.get_column_names()));
+    for (uint i = 0; i < some.size(); i++) {
+        some[i].set(0, (int32_t) i);
+        some[i].set(1, "unique");
+    }
+    delete unique_table.insert_batch(some);
+    Rows clashing(3, Row(&unique_table.get_column_names()));
+    for (uint i = 0; i < clashing.size(); i++) {
+        clashing[i].set(0, (int32_t) (i == 1 ? 7 : 500 + i));
+        clashing[i].set(1, "clashing");
+    }
+    try {
+        delete unique_table.insert_batch(clashing);
+        ok = false;
+    } catch (DbRelationError &e) {
+        // expected, and none of the batch is left in the table or the index
+    }
+    u_int64_t sevens = 0;
+    Row a_only(&unique.get_key_columns());
+    handles = unique_table.select();
+    for (Handle handle : *handles) {
+        unique_table.project(handle, a_only);
+        sevens += a_only.get_int(0) == 7;
+    }
+    ok = ok && sevens == 1 && handles->size() == some.size();
+    delete handles;
+    where.clear();
+    where["a"] = Value(500);
+    handles = unique_table.select(&where);
+    ok = ok && handles->empty();
+    delete handles;
+    u_int64_t n_rows = unique_table.count();
+    try {
+        unique_table.insert(some[7]);
+        ok = false;
+    } catch (DbRelationError &e) {
+        // expected, and the row is taken back out of the table
+    }
+    ok = ok && unique_table.count() == n_rows;
+    some[7].set(0, 1000);
+    delete unique_table.insert_batch(Rows(1, some[7])); // nothing was left latched
+    where.clear();
+    where["a"] = Value(1000);
+    handles = unique_table.select(&where);
+    ok = ok && handles->size() == 1;
+    delete handles;
+    if (!ok)
+        std::cout << "unique hash index did not check batches" << std::endl;
+    unique_table.remove_index(&unique);
+    unique.drop();
+    unique_table.drop();
+    return ok;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file hash_index.h - Linear hash index for equality lookups.
+ * HashIndex
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <vector>
+#include "heap_storage.h"
+
+/**
+ * @class HashIndex - disk-based linear hash index mapping the values of one column to handles
+ *
+ *      Meant for equality lookups on TEXT keys, where comparing whole strings down a tree is costly,
+        though INT keys work too. An entry is a 32-bit hash of the key and the row's handle; keys
+        themselves are not stored, so lookup() can return a row whose key only hashes the same (rare;
+        HeapTable::select checks every row it gets back).
+
+        Each bucket is one primary page, plus a chain of overflow pages when it fills up. Primary
+        pages are in one HeapFile at fixed blocks (bucket b is block b + 2, block 1 holds the
+        Meta), so finding a bucket takes no reads; overflow pages are in a second HeapFile.
+        Linear hashing grows the table one bucket at a time: when the average bucket is more than
+        SPLIT_FILL full, the bucket at the split pointer is split into itself and one new bucket,
+        so there is never a full rehash. Pages freed by a split are kept on a free list for reuse.
+        A lookup reads one primary page and, rarely, an overflow page or two.
+ */
+class HashIndex : public DbIndex {
+public:
+    struct Entry {
+        u_int32_t hash;
+        BlockID block_id;
+        RecordID record_id;
+    };
+
+    struct Header {
+        u_int16_t size;     // number of entries
+        u_int16_t unused;
+        BlockID overflow;   // next page of the bucket in the overflow file, or 0
+    };
+
+    struct Meta {
+        u_int32_t initial_buckets;  // buckets at level 0
+        u_int32_t level;            // buckets double in number each level
+        u_int32_t split;            // next bucket to split in this level
+        u_int32_t n_buckets;
+        u_int64_t n_entries;
+        BlockID free_overflow;      // first page of the overflow free list, or 0
+    };
+
+    static const uint PAGE_CAPACITY = (DbBlock::BLOCK_SZ - sizeof(Header)) / sizeof(Entry);
+    static const uint MIN_BUCKETS = 4;
+    static constexpr double SPLIT_FILL = 0.75;
+
+    HashIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique = false);
+
+    virtual ~HashIndex() {}
+
+    HashIndex(const HashIndex &other) = delete;
+
+    HashIndex(HashIndex &&temp) = delete;
+
+    HashIndex &operator=(const HashIndex &other) = delete;
+
+    HashIndex &operator=(HashIndex &&temp) = delete;
+
+    virtual void create();
+
+    virtual void drop();
+
+    virtual void open();
+
+    virtual void close();
+
+    virtual Handles *lookup(const ValueDict *key_values);
+
+    using DbIndex::insert;
+    using DbIndex::del;
+
+    virtual void insert(Handle handle, const Row &row);
+
+    virtual void del(Handle handle, const Row &row);
+
+    virtual void update(Handle handle, const Row &old_row, const Row &new_row);
+
+    virtual u_int32_t get_bucket_count() const { return meta.n_buckets; }
+
+    static u_int32_t hash(const ValueView &key);
+
+protected:
+    HeapFile file;
+    HeapFile overflow_file;
+    BufferPool pool;
+    BufferPool overflow_pool;
+    uint key_column;    // ordinal of the key column in the relation
+    Meta meta;
+    bool closed;
+
+    virtual u_int32_t bucket(u_int32_t hash) const;
+
+    virtual void find(u_int32_t hash, Handles *handles);
+
+    virtual void add(u_int32_t bucket, const Entry &entry);
+
+    virtual bool remove(u_int32_t bucket, const Entry &entry);
+
+    virtual void split(void);
+
+    virtual SlottedPage *new_overflow_page(void);
+
+    virtual void write_meta(void);
+
+    static Header *header(SlottedPage *page) { return (Header *) page->get_data(); }
+
+    static Entry *entries(SlottedPage *page) { return (Entry *) ((char *) page->get_data() + sizeof(Header)); }
+};
+
+bool test_hash_index();
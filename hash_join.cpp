@@ -0,0 +1,358 @@
+#include "hash_join.h"
+#include "hash_index.h"
+#include <cstdint>
+
+/**
+ * @class HashJoin
+ *
+ * Joins two inputs on equal keys with a hash table on the smaller one, partitioning to disk if it
+ * does not fit in memory.
+ */
+
+static const uint END_OF_CHAIN = UINT32_MAX;
+
+/**
+ * @param left the left input (owned)
+ * @param right the right input (owned)
+ * @param left_key the left input's join column
+ * @param right_key the right input's join column (of the same type)
+ * @param type which unmatched rows are kept
+ * @param memory_budget bytes of build rows to hold in memory before partitioning
+ */
+HashJoin::HashJoin(EvalPlan *left, EvalPlan *right, uint left_key, uint right_key, JoinType type,
+                   size_t memory_budget) : left(left), right(right), left_key(left_key), right_key(right_key),
+            type(type), memory_budget(memory_budget), column_names(left->get_column_names()),
+            column_attributes(left->get_column_attributes()), build_left(false), build_rows(), hashes(), heads(),
+            chain(), matched(), build_bytes(0), partitioned(false), build_partitions(), probe_partitions(),
+            partition(0), probe_batch(), probe_pos(0), walking(false), chain_pos(END_OF_CHAIN), probe_hash(0), probe_matched(false),
+            probe_done(false), unmatched_pos(0) {
+    column_names.insert(column_names.end(), right->get_column_names().begin(), right->get_column_names().end());
+    column_attributes.insert(column_attributes.end(), right->get_column_attributes().begin(),
+                             right->get_column_attributes().end());
+}
+
+HashJoin::~HashJoin() {
+    clear();
+    delete left;
+    delete right;
+}
+
+/**
+ * Read the build side into the hash table (or into partitions, along with the probe side)
+ * The build side is picked here rather than when planning, since a plan can be run again after
+ * its tables have grown.
+ */
+void HashJoin::open() {
+    clear();
+    build_left = left->estimate_blocks() < right->estimate_blocks();
+    partitioned = false;
+    left->open();
+    right->open();
+    RowBatch batch;
+    while (build_input()->next(batch)) {
+        for (uint i = 0; i < batch.size(); i++) {
+            if (partitioned) {
+                spill(batch[i], build_key(), build_partitions);
+            } else {
+                add_build_row(batch[i]);
+                if (build_bytes > memory_budget)
+                    start_partitions();
+            }
+        }
+    }
+    if (partitioned) {
+        while (probe_input()->next(batch))
+            for (uint i = 0; i < batch.size(); i++)
+                spill(batch[i], probe_key(), probe_partitions);
+        for (uint p = 0; p < PARTITIONS; p++) {
+            build_partitions[p]->rewind();
+            probe_partitions[p]->rewind();
+        }
+        load_partition();
+    } else {
+        index_build_rows();
+    }
+}
+
+/**
+ * Get the next joined rows
+ * @param batch filled with the next rows
+ * @return false when there are no more
+ */
+bool HashJoin::next(RowBatch &batch) {
+    batch.clear();
+    while (true) {
+        if (probe_pos < probe_batch.size()) {
+            const Row &probe_row = probe_batch[probe_pos];
+            if (!walking) {
+                walking = true;
+                probe_matched = false;
+                chain_pos = END_OF_CHAIN;
+                if (!probe_row.is_null(probe_key()) && !heads.empty()) {
+                    probe_hash = HashIndex::hash(probe_row.get(probe_key()));
+                    chain_pos = heads[probe_hash & (heads.size() - 1)];
+                }
+            }
+            ValueView key = probe_row.get(probe_key());
+            while (chain_pos != END_OF_CHAIN) {
+                if (batch.full())
+                    return true;
+                uint i = chain_pos;
+                chain_pos = chain[i];
+                if (hashes[i] == probe_hash && build_rows[i].get(build_key()).compare(key) == 0) {
+                    emit(batch, &probe_row, &build_rows[i]);
+                    probe_matched = true;
+                    if (build_outer())
+                        matched[i] = true;
+                }
+            }
+            if (!probe_matched && probe_outer()) {
+                if (batch.full())
+                    return true;
+                emit(batch, &probe_row, nullptr);
+            }
+            probe_pos++;
+            walking = false;
+            continue;
+        }
+
+        if (!probe_done) {
+            probe_pos = 0;
+            if (next_probe_batch())
+                continue;
+            probe_done = true;
+        }
+        if (build_outer()) {
+            while (unmatched_pos < build_rows.size()) {
+                if (batch.full())
+                    return true;
+                size_t i = unmatched_pos++;
+                if (!matched[i])
+                    emit(batch, nullptr, &build_rows[i]);
+            }
+        }
+        if (partitioned && partition + 1 < PARTITIONS) {
+            partition++;
+            load_partition();
+            continue;
+        }
+        return !batch.empty();
+    }
+}
+
+void HashJoin::close() {
+    left->close();
+    right->close();
+    clear();
+}
+
+/**
+ * Copy a row into the build side's rows (the hash table is built once they are all in)
+ * @param row a row of the build input
+ */
+void HashJoin::add_build_row(const Row &row) {
+    build_rows.push_back(row);
+    build_bytes += row_bytes(row);
+}
+
+/**
+ * Hash the build rows and chain them by hash, keeping each chain in the order the rows came in
+ */
+void HashJoin::index_build_rows(void) {
+    size_t n_heads = 1;
+    while (n_heads < build_rows.size())
+        n_heads *= 2;
+    heads.assign(n_heads, END_OF_CHAIN);
+    chain.assign(build_rows.size(), END_OF_CHAIN);
+    hashes.assign(build_rows.size(), 0);
+    matched.assign(build_outer() ? build_rows.size() : 0, false);
+    for (size_t i = build_rows.size(); i-- > 0;) {
+        if (build_rows[i].is_null(build_key()))
+            continue; // never matches
+        hashes[i] = HashIndex::hash(build_rows[i].get(build_key()));
+        uint &head = heads[hashes[i] & (n_heads - 1)];
+        chain[i] = head;
+        head = (uint) i;
+    }
+}
+
+/**
+ * Write a row to the partition its key hashes to
+ * @param row the row
+ * @param key its join column
+ * @param partitions the partitions of its side
+ */
+void HashJoin::spill(const Row &row, uint key, std::vector<SpillFile *> &partitions) {
+    uint p = row.is_null(key) ? 0 : (HashIndex::hash(row.get(key)) >> 16) % PARTITIONS; // not the bits heads use
+    partitions[p]->append(row);
+}
+
+/**
+ * Switch to grace partitioning: make the partitions and move the build rows read so far into them
+ */
+void HashJoin::start_partitions(void) {
+    partitioned = true;
+    for (uint p = 0; p < PARTITIONS; p++) {
+        build_partitions.push_back(new SpillFile(build_input()->get_column_attributes()));
+        probe_partitions.push_back(new SpillFile(probe_input()->get_column_attributes()));
+    }
+    for (const Row &row : build_rows)
+        spill(row, build_key(), build_partitions);
+    build_rows.clear();
+    build_bytes = 0;
+}
+
+/**
+ * Read the current partition's build rows into the hash table and get ready to probe it
+ */
+void HashJoin::load_partition(void) {
+    build_rows.clear();
+    build_bytes = 0;
+    Row row(&build_input()->get_column_names());
+    while (build_partitions[partition]->next(row))
+        add_build_row(row);
+    index_build_rows();
+    probe_batch.clear();
+    probe_pos = 0;
+    walking = false;
+    probe_done = false;
+    unmatched_pos = 0;
+}
+
+/**
+ * Get the next batch of probe rows, from the probe input or the current partition
+ * @return false if there are no more
+ */
+bool HashJoin::next_probe_batch(void) {
+    if (!partitioned)
+        return probe_input()->next(probe_batch);
+    probe_batch.clear();
+    const ColumnNames *names = &probe_input()->get_column_names();
+    while (!probe_batch.full()) {
+        Row &row = probe_batch.add(names);
+        if (!probe_partitions[partition]->next(row)) {
+            probe_batch.truncate(probe_batch.size() - 1);
+            break;
+        }
+    }
+    return !probe_batch.empty();
+}
+
+/**
+ * Add a joined row to the batch
+ * @param batch the batch (not full)
+ * @param probe_row the probe side's row, or nullptr for NULLs
+ * @param build_row the build side's row, or nullptr for NULLs
+ */
+void HashJoin::emit(RowBatch &batch, const Row *probe_row, const Row *build_row) {
+    Row &out = batch.add(&column_names);
+    const Row *left_row = build_left ? build_row : probe_row;
+    const Row *right_row = build_left ? probe_row : build_row;
+    uint n_left = (uint) left->get_column_names().size();
+    for (uint col_num = 0; col_num < column_names.size(); col_num++) {
+        const Row *from = col_num < n_left ? left_row : right_row;
+        uint from_col_num = col_num < n_left ? col_num : col_num - n_left;
+        if (from == nullptr)
+            out.set_null(col_num, column_attributes[col_num].get_data_type());
+        else
+            out.set(col_num, *from, from_col_num);
+    }
+}
+
+/**
+ * Drop the hash table, the partitions and the probe state
+ */
+void HashJoin::clear(void) {
+    build_rows.clear();
+    hashes.clear();
+    heads.clear();
+    chain.clear();
+    matched.clear();
+    build_bytes = 0;
+    for (SpillFile *spill_file : build_partitions)
+        delete spill_file;
+    build_partitions.clear();
+    for (SpillFile *spill_file : probe_partitions)
+        delete spill_file;
+    probe_partitions.clear();
+    partition = 0;
+    probe_batch.clear();
+    probe_pos = 0;
+    walking = false;
+    probe_done = false;
+    unmatched_pos = 0;
+}
+
+/**
+ * Count a join's rows, and those with NULLs on the left or on the right
+ */
+static void count_join(HashJoin &join, uint n_left, uint &n, uint &left_nulls, uint &right_nulls, bool &keys_equal) {
+    n = left_nulls = right_nulls = 0;
+    keys_equal = true;
+    RowBatch batch;
+    join.open();
+    while (join.next(batch)) {
+        for (uint i = 0; i < batch.size(); i++) {
+            const Row &row = batch[i];
+            n++;
+            if (row.is_null(0))
+                left_nulls++;
+            else if (row.is_null(n_left))
+                right_nulls++;
+            else if (row.get_int(0) != row.get_int(n_left))
+                keys_equal = false;
+        }
+    }
+    join.close();
+}
+
+bool test_hash_join() {
+    ColumnNames customer_names;
+    customer_names.push_back("id");
+    customer_names.push_back("name");
+    ColumnAttributes customer_attributes;
+    customer_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    customer_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable customers("_test_hash_join_customers_cpp", customer_names, customer_attributes);
+    customers.create();
+    ColumnNames order_names;
+    order_names.push_back("customer");
+    order_names.push_back("item");
+    HeapTable orders("_test_hash_join_orders_cpp", order_names, customer_attributes);
+    orders.create();
+
+    // customers 0 - 259; orders for customers 25 - 274, four each
+    Rows rows(260, Row(&customer_names));
+    for (int i = 0; i < 260; i++) {
+        rows[i].set(0, i);
+        rows[i].set(1, "customer " + std::to_string(i));
+    }
+    delete customers.insert_batch(rows);
+    rows.assign(1000, Row(&order_names));
+    for (int i = 0; i < 1000; i++) {
+        rows[i].set(0, i % 250 + 25);
+        rows[i].set(1, std::string(50, 'a' + i % 26));
+    }
+    delete orders.insert_batch(rows);
+
+    bool ok = true;
+    const HashJoin::JoinType types[] = {HashJoin::INNER, HashJoin::LEFT, HashJoin::RIGHT, HashJoin::FULL};
+    const uint expected[] = {940, 965, 1000, 1025};
+    for (uint t = 0; t < 4; t++) {
+        for (size_t memory : {HashJoin::DEFAULT_MEMORY, (size_t) 4096}) {
+            HashJoin join(new TableScan(customers), new TableScan(orders), 0, 0, types[t], memory);
+            uint n, left_nulls, right_nulls;
+            bool keys_equal;
+            count_join(join, 2, n, left_nulls, right_nulls, keys_equal);
+            bool keeps_left = types[t] == HashJoin::LEFT || types[t] == HashJoin::FULL;
+            bool keeps_right = types[t] == HashJoin::RIGHT || types[t] == HashJoin::FULL;
+            ok = ok && n == expected[t] && keys_equal && left_nulls == (keeps_right ? 60 : 0)
+                 && right_nulls == (keeps_left ? 25 : 0) && join.is_partitioned() == (memory == 4096);
+        }
+    }
+    if (!ok)
+        std::cout << "hash join did not return the right rows" << std::endl;
+    customers.drop();
+    orders.drop();
+    return ok;
+}
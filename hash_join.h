@@ -0,0 +1,118 @@
+/**
+ * @file hash_join.h - Equi-join operator with grace partitioning.
+ * HashJoin
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include "eval_plan.h"
+#include "spill_file.h"
+
+/**
+ * @class HashJoin - rows of two inputs whose key columns are equal, for INNER, LEFT, RIGHT and FULL joins
+ *
+ *      The input with the smaller estimated size is the build side: its rows are copied into a
+        chained hash table. The other (probe) side is then read a batch at a time and each row's
+        chain is walked. An output row is the left input's columns followed by the right input's;
+        for the outer joins, a row without a match gets NULLs for the other side's columns (a
+        build row's matches are flagged, and unmatched ones are sent after the probe side ends).
+        NULL keys never match.
+
+        If the build rows take more than memory_budget bytes, the join goes grace: the build rows,
+        and then all of the probe rows, are split by key hash into PARTITIONS pairs of SpillFiles,
+        and each pair is joined in memory in turn. A partition that is still too big is joined in
+        memory anyway (there is no recursive partitioning).
+ */
+class HashJoin : public EvalPlan {
+public:
+    enum JoinType {
+        INNER, LEFT, RIGHT, FULL
+    };
+
+    static const uint PARTITIONS = 16;
+    static const size_t DEFAULT_MEMORY = 64 * 1024 * 1024;
+
+    HashJoin(EvalPlan *left, EvalPlan *right, uint left_key, uint right_key, JoinType type = INNER,
+             size_t memory_budget = DEFAULT_MEMORY);
+
+    virtual ~HashJoin();
+
+    virtual void open();
+
+    virtual bool next(RowBatch &batch);
+
+    virtual void close();
+
+    virtual const ColumnNames &get_column_names() const { return column_names; }
+
+    virtual const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+
+    virtual u_int64_t estimate_blocks() const { return left->estimate_blocks() + right->estimate_blocks(); }
+
+    virtual bool is_partitioned() const { return partitioned; }
+
+protected:
+    EvalPlan *left;
+    EvalPlan *right;
+    uint left_key;
+    uint right_key;
+    JoinType type;
+    size_t memory_budget;
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    bool build_left;            // whether the left input is the build side
+
+    // the hash table: build_rows[i] has key hash hashes[i] and is followed in its chain by chain[i]
+    Rows build_rows;
+    std::vector<u_int32_t> hashes;
+    std::vector<uint> heads;
+    std::vector<uint> chain;
+    std::vector<bool> matched;
+    size_t build_bytes;
+
+    bool partitioned;           // whether the last open() went grace
+    std::vector<SpillFile *> build_partitions;
+    std::vector<SpillFile *> probe_partitions;
+    uint partition;             // being joined
+
+    // where next() left off
+    RowBatch probe_batch;
+    uint probe_pos;
+    bool walking;               // whether the chain of probe_batch[probe_pos] is being walked
+    uint chain_pos;
+    u_int32_t probe_hash;
+    bool probe_matched;
+    bool probe_done;
+    size_t unmatched_pos;       // next build row to check for being unmatched
+
+    EvalPlan *build_input() const { return build_left ? left : right; }
+
+    EvalPlan *probe_input() const { return build_left ? right : left; }
+
+    uint build_key() const { return build_left ? left_key : right_key; }
+
+    uint probe_key() const { return build_left ? right_key : left_key; }
+
+    bool build_outer() const { return type == FULL || type == (build_left ? LEFT : RIGHT); }
+
+    bool probe_outer() const { return type == FULL || type == (build_left ? RIGHT : LEFT); }
+
+    virtual void add_build_row(const Row &row);
+
+    virtual void index_build_rows(void);
+
+    virtual void spill(const Row &row, uint key, std::vector<SpillFile *> &partitions);
+
+    virtual void start_partitions(void);
+
+    virtual void load_partition(void);
+
+    virtual bool next_probe_batch(void);
+
+    virtual void emit(RowBatch &batch, const Row *probe_row, const Row *build_row);
+
+    virtual void clear(void);
+};
+
+bool test_hash_join();
@@ -9,8 +9,15 @@
  */
 #pragma once
 
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
 #include "db_cxx.h"
 #include "storage_engine.h"
+#include "buffer_pool.h"
+#include "latch.h"
+#include "row_codec.h"
+#include "stats.h"
 
 /**
  * @class SlottedPage - heap file implementation of DbBlock.
@@ -25,10 +32,21 @@
             Bytes 0x04 - 0x05: size of record 1
             Bytes 0x06 - 0x07: offset to record 1
             etc.
+
+        Deleting a record only zeroes its header (a tombstone), shrinking a record leaves its tail
+        behind, and growing a record writes the new copy into the free space. The holes this leaves
+        are only reclaimed by compact(), which runs when an add() or put() would otherwise not fit,
+        so single-record updates and deletes do not move the other records.
+
+        Each page carries a Latch. A SlottedPage is not safe to use from more than one thread by
+        itself; the BufferPool takes the latch of a frame's page for whoever pins it (shared to read,
+        exclusive to change it).
  *
  */
 class SlottedPage : public DbBlock {
 public:
+    static const uint MAX_RECORD_SZ = DbBlock::BLOCK_SZ - 8; // what an empty block holds: all but its header and one slot
+
     SlottedPage(Dbt &block, BlockID block_id, bool is_new = false);
 
     // Big 5 - we only need the destructor, copy-ctor, move-ctor, and op= are unnecessary
@@ -43,27 +61,54 @@ public:
 
     SlottedPage &operator=(SlottedPage &temp) = delete;
 
+    virtual void initialize_new(void);
+
     virtual RecordID add(const Dbt *data);
 
+    virtual void *reserve(u_int16_t size, RecordID &record_id);
+
     virtual Dbt *get(RecordID record_id);
 
+    virtual RecordView view(RecordID record_id);
+
     virtual void put(RecordID record_id, const Dbt &data);
 
     virtual void del(RecordID record_id);
 
     virtual RecordIDs *ids(void);
 
+    virtual RecordID get_last_id() { return num_records; }
+
+    virtual bool has(RecordID record_id);
+
+    virtual u_int16_t count(void);
+
+    virtual u_int16_t free_space(void);
+
+    virtual void reset(Dbt &block, BlockID block_id);
+
+    virtual Latch &get_latch() { return latch; }
+
 protected:
     u_int16_t num_records;
     u_int16_t end_free;
+    Latch latch;
 
     virtual void get_header(u_int16_t &size, u_int16_t &loc, RecordID id = 0);
 
     virtual void put_header(RecordID id = 0, u_int16_t size = 0, u_int16_t loc = 0);
 
+    int fragmented_bytes; // bytes in holes left by del/put, or -1 if not counted yet
+
     virtual bool has_room(u_int16_t size);
 
-    virtual void slide(u_int16_t start, u_int16_t end);
+    virtual u_int16_t unused(void);
+
+    virtual u_int16_t fragmented(void);
+
+    virtual void add_fragmented(u_int16_t size);
+
+    virtual void compact(void);
 
     virtual u_int16_t get_n(u_int16_t offset);
 
@@ -72,6 +117,43 @@ protected:
     virtual void *address(u_int16_t offset);
 };
 
+/**
+ * @class HeapFileIterator - heap file implementation of DbBlockIterator
+ *
+ * Walks the blocks of a HeapFile in BlockID order with a Berkeley DB cursor, so each block is read
+ * exactly once and nothing is materialized up front. The current SlottedPage wraps memory owned by
+ * the iterator, so it is only valid until the next call to next().
+ */
+class HeapFileIterator : public DbBlockIterator {
+public:
+    HeapFileIterator(Db &db);
+
+    virtual ~HeapFileIterator();
+
+    HeapFileIterator(const HeapFileIterator &other) = delete;
+
+    HeapFileIterator(HeapFileIterator &&temp) = delete;
+
+    HeapFileIterator &operator=(const HeapFileIterator &other) = delete;
+
+    HeapFileIterator &operator=(HeapFileIterator &&temp) = delete;
+
+    virtual bool next();
+
+    virtual BlockID get_block_id() { return block_id; }
+
+    virtual SlottedPage *get_block() { return page; }
+
+protected:
+    Dbc *cursor;
+    db_recno_t recno;
+    Dbt key;
+    std::vector<char> buffer;   // each block is read into here
+    Dbt data;
+    BlockID block_id;
+    SlottedPage *page;
+};
+
 /**
  * @class HeapFile - heap file implementation of DbFile
  *
@@ -79,13 +161,21 @@ protected:
         database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
         for buffer management and file management.
         Uses SlottedPage for storing records within blocks.
+        read(), put(), allocate() and append() may be called from several threads at once (each new
+        block gets its own id); get() and get_new() share one buffer, so they may not.
  */
 class HeapFile : public DbFile {
 public:
-    HeapFile(std::string name) : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {}
+    /**
+     * @param name    the file's name (without the .db)
+     * @param logged  whether its creates, drops and block changes go to the _DB_LOG (not for files that
+     *                can be rebuilt or thrown away after a crash)
+     */
+    HeapFile(std::string name, bool logged = true) : DbFile(name), dbfilename(name + ".db"), last(0), closed(true),
+                                                     logged(logged), db(_DB_ENV, 0), get_buffer(DbBlock::BLOCK_SZ) {}
 
     virtual ~HeapFile() {
-        std::cout <<"In destructor" << std::endl; // this line was written by David
+        TRACE(1, "In destructor"); // this line was written by David
     }
 
     HeapFile(const HeapFile &other) = delete;
@@ -110,26 +200,254 @@ public:
 
     virtual void put(DbBlock *block);
 
+    virtual void read(BlockID block_id, void *buffer);
+
+    virtual BlockID allocate(void *buffer);
+
+    virtual void allocate(void *buffer, BlockID block_id);
+
+    virtual BlockID next_block_id() { return ++last; }    // the id for a new block, to allocate(buffer, id)
+
+    virtual BlockID append(const void *buffer);
+
+    virtual void sync(void);
+
     virtual BlockIDs *block_ids();
 
-    virtual u_int32_t get_last_block_id() { return last; }
+    virtual HeapFileIterator *blocks();
+
+    virtual u_int32_t get_last_block_id() { return last.load(); }
+
+    virtual const std::string &get_name() const { return name; }
+
+    virtual bool is_logged() const { return logged; }
+
+    virtual bool is_open() const { return !closed; }
 
 protected:
     std::string dbfilename;
-    u_int32_t last;
+    std::atomic<u_int32_t> last;
     bool closed;
+    bool logged;
     Db db;
+    std::vector<char> get_buffer;   // memory for the block returned by get()
 
     virtual void db_open(uint flags = 0);
 };
 
+/**
+ * @class FreeSpaceMap - persistent record of how full each block of a HeapFile is
+ *
+ *      Keeps one fill level (0 - 63, in units of LEVEL_SZ free bytes) per heap block so that inserts
+        can find a block with room without reading any blocks. The levels are stored in their own
+        HeapFile, one record of up to ENTRIES_PER_BLOCK levels per block, and are loaded into memory
+        on open and written back on close.
+
+        For each level there is a stack of candidate blocks. A block is pushed when its level changes
+        and stale entries are dropped when they are popped, so find() is O(1) amortized.
+        Levels round down, so a block always has at least as much room as its level promises.
+
+        find() and update() may be called from several threads at once. A block find() hands out is
+        lent to its caller until the caller's update() says how full it is now, and is not handed out
+        again meanwhile, so concurrent inserters fill different blocks (or add new ones) instead of
+        queuing up for the same one.
+ */
+class FreeSpaceMap {
+public:
+    static const uint LEVELS = 64;
+    static const uint LEVEL_SZ = DbBlock::BLOCK_SZ / LEVELS;
+    static const uint ENTRIES_PER_BLOCK = 4000;
+
+    FreeSpaceMap(std::string name);
+
+    virtual ~FreeSpaceMap() {}
+
+    FreeSpaceMap(const FreeSpaceMap &other) = delete;
+
+    FreeSpaceMap(FreeSpaceMap &&temp) = delete;
+
+    FreeSpaceMap &operator=(const FreeSpaceMap &other) = delete;
+
+    FreeSpaceMap &operator=(FreeSpaceMap &&temp) = delete;
+
+    virtual void create(void);
+
+    virtual void drop(void);
+
+    virtual void open(void);
+
+    virtual void close(void);
+
+    virtual BlockID find(u_int16_t size);
+
+    virtual void update(BlockID block_id, u_int16_t free_space);
+
+    virtual void release(BlockID block_id);
+
+    virtual u_int32_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (u_int32_t) levels.size();
+    }
+
+    virtual HeapFile &get_file() { return file; }
+
+protected:
+    HeapFile file;
+    std::mutex mutex;                       // guards levels, candidates, lent and dirty
+    std::vector<u_int8_t> levels;           // levels[block_id - 1]
+    std::vector<BlockIDs> candidates;       // candidates[level] - may hold stale entries
+    std::vector<bool> dirty;                // dirty[map block - 1]
+    std::unordered_set<BlockID> lent;       // blocks find() has handed out that update() has not returned
+    size_t candidate_count;
+    bool closed;
+
+    virtual void push(BlockID block_id, u_int8_t level);
+
+    virtual void rebuild_candidates(void);
+};
+
+/**
+ * @class ZoneMap - persistent summary of the values in each block of a HeapFile
+ *
+ *      Keeps a Zone per heap block and column: the smallest and largest key among the column's
+        values in that block. An INT's key is its value; a TEXT's key is its first PREFIX_SZ bytes,
+        so TEXT bounds are only as tight as the prefixes. Before reading a block, a scan asks
+        might_match() whether any of its rows could satisfy the predicates, and skips the block if
+        not. Zones only ever widen (an update widens its block's zones, nothing narrows them), so
+        they stay correct but can get loose under updates. Only the first MAX_COLUMNS columns are
+        tracked. Stored like the FreeSpaceMap: the zones of ENTRIES_PER_BLOCK heap blocks to a
+        block of their own HeapFile, loaded into memory on open and written back on close.
+        extend(), add() and might_match() may be called from several threads at once: a Latch lets
+        scans check zones side by side while inserts widen them one at a time.
+ */
+class ZoneMap {
+public:
+    struct Zone {
+        u_int64_t min;
+        u_int64_t max;
+    };
+
+    static const uint PREFIX_SZ = sizeof(u_int64_t);
+    static const uint MAX_COLUMNS = SlottedPage::MAX_RECORD_SZ / sizeof(Zone);
+
+    ZoneMap(std::string name, const ColumnAttributes &column_attributes);
+
+    virtual ~ZoneMap() {}
+
+    ZoneMap(const ZoneMap &other) = delete;
+
+    ZoneMap(ZoneMap &&temp) = delete;
+
+    ZoneMap &operator=(const ZoneMap &other) = delete;
+
+    ZoneMap &operator=(ZoneMap &&temp) = delete;
+
+    virtual void create(void);
+
+    virtual void drop(void);
+
+    virtual void open(void);
+
+    virtual void close(void);
+
+    virtual void extend(BlockID block_id);
+
+    virtual void add(BlockID block_id, const Row &row);
+
+    virtual bool might_match(BlockID block_id, const Predicates &where, const std::vector<uint> &col_nums) const;
+
+    virtual u_int32_t size() const { return n_blocks; }
+
+    static u_int64_t key(const ValueView &value);
+
+    static u_int64_t key(const Value &value);
+
+protected:
+    HeapFile file;
+    std::vector<ColumnAttribute::DataType> types;   // of the tracked columns
+    uint entries_per_block;                         // heap blocks summarized by each map block
+    u_int32_t n_blocks;
+    std::vector<Zone> zones;                        // zones[(block_id - 1) * types.size() + col_num]
+    std::vector<bool> dirty;                        // dirty[map block - 1]
+    bool closed;
+    mutable Latch latch;                            // guards n_blocks, zones and dirty
+
+    virtual void grow(BlockID block_id);
+
+    static u_int64_t key(ColumnAttribute::DataType data_type, int32_t n, const char *s, size_t size);
+};
+
+class HeapTable;
+
+/**
+ * @class HeapTableIterator - heap storage implementation of DbRelationIterator
+ *
+ * Walks the slot directory of each block in turn, so only one block is held at a time and no list of
+ * record ids or handles is ever built. Each block is copied out of the table's buffer pool while it
+ * is pinned, so no latch is held between calls (the rows are as they were when the block was reached).
+ */
+class HeapTableIterator : public DbRelationIterator {
+public:
+    HeapTableIterator(HeapTable &table);
+
+    virtual ~HeapTableIterator();
+
+    HeapTableIterator(const HeapTableIterator &other) = delete;
+
+    HeapTableIterator(HeapTableIterator &&temp) = delete;
+
+    HeapTableIterator &operator=(const HeapTableIterator &other) = delete;
+
+    HeapTableIterator &operator=(HeapTableIterator &&temp) = delete;
+
+    virtual bool next();
+
+    virtual Handle get_handle();
+
+    virtual ValueDict *get_row();
+
+    virtual void get_row(Row &row);
+
+    virtual const ValueViews &get_row_view();
+
+    virtual RecordView get_record();
+
+protected:
+    HeapTable &table;
+    BlockID block_id;           // the block being walked, or 0 before the first
+    BlockID last;               // the table's last block when the scan started
+    std::vector<char> buffer;   // a copy of the block being walked
+    Dbt data;
+    SlottedPage *block;
+    RecordID record_id;
+    ValueViews values;
+};
+
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ * All block access goes through a BufferPool in front of the HeapFile, so repeated accesses to the
+ * same block (e.g. appends to the last block, or projecting several rows from one block) do not
+ * go back to Berkeley DB. Dirty blocks are written back on eviction and when the table is closed.
+ * Inserts go to any block the FreeSpaceMap says has room, not just the last one.
+ * A ZoneMap summarizes the values in each block, so filtered scans skip blocks without reading them.
+ * Rows are encoded by a RowCodec built from the schema when the table is constructed.
+ * Internally rows are Rows (values by column ordinal); the ValueDict methods convert at the boundary.
+ * Indices added with add_index() are maintained by every insert and update, and select(where) uses
+ * one for an equality or range predicate on its key instead of scanning the whole table.
+ * parallel_select() splits a full scan into runs of blocks checked by a pool of worker threads.
+ * Once created or opened, a table may be used from several threads at once: blocks are latched
+ * through the pool (exclusive for insert and update, shared for project), the free-space map lends
+ * each inserter its own block, and index lookups share a latch that index maintenance takes
+ * exclusively. create, drop and close must not run alongside anything else.
  */
 
 class HeapTable : public DbRelation {
 public:
-    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes);
+    static const uint PARALLEL_CHUNK_BLOCKS = 16;   // fewest blocks a parallel_select worker takes at a time
+
+    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+              uint buffer_frames = BufferPool::DEFAULT_FRAMES);
 
     virtual ~HeapTable() {}
 
@@ -153,28 +471,96 @@ public:
 
     virtual Handle insert(const ValueDict *row);
 
+    virtual Handle insert(const Row &row);
+
+    virtual Handles *insert_batch(const Rows &rows);
+
     virtual void update(const Handle handle, const ValueDict *new_values);
 
+    virtual void update(const Handle handle, const Row &new_values);
+
     virtual void del(const Handle handle);
 
     virtual Handles *select();
 
     virtual Handles *select(const ValueDict *where);
 
+    virtual Handles *select(const Predicates &where);
+
+    virtual Handles *parallel_select(const Predicates &where, uint n_threads, bool ordered = true);
+
+    virtual HeapTableIterator *scan();
+
+    virtual u_int64_t count();
+
     virtual ValueDict *project(Handle handle);
 
     virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
 
+    virtual void project(Handle handle, Row &row);
+
+    virtual BufferPool &get_buffer_pool() { return pool; }
+
+    virtual u_int32_t get_block_count() {
+        open();
+        return file.get_last_block_id();
+    }
+
+    virtual void add_index(DbIndex *index);
+
+    virtual void remove_index(DbIndex *index);
+
+    virtual const DbIndices &get_indices() const { return indices; }
+
 protected:
     HeapFile file;
+    BufferPool pool;
+    FreeSpaceMap fsm;
+    ZoneMap zones;
+    RowCodec codec;
+    DbIndices indices;  // kept up to date on every insert and update (not owned)
+    std::atomic<uint> n_indices;    // indices.size(), so inserts and updates can skip index_latch when it is 0
+    std::atomic<bool> opened;
+    std::mutex open_mutex;
+    Latch index_latch;      // guards indices: shared for lookups, exclusive to change them or their entries
+
+    virtual void validate(const ValueDict *row, Row &values);
+
+    virtual const Row &validate(const Row &row, Row &ordered);
+
+    virtual int column_index(const Identifier &column_name) const;
+
+    virtual std::vector<uint> predicate_columns(const Predicates &where) const;
+
+    virtual Handles *index_candidates(const Predicates &where);
 
-    virtual ValueDict *validate(const ValueDict *row);
+    virtual Handles *filter(Handles *candidates, const Predicates &where, const std::vector<uint> &col_nums);
 
-    virtual Handle append(const ValueDict *row);
+    virtual bool matches(RecordView record, const Predicates &where, const std::vector<uint> &col_nums) const;
+
+    virtual void scan_blocks(BlockID first, BlockID last, const Predicates &where, const std::vector<uint> &col_nums,
+                             Handles &handles);
+
+    virtual Handle append(const Row &row);
+
+    virtual void *reserve(SlottedPage *&block, u_int16_t size, RecordID &record_id);
+
+    virtual void return_block(SlottedPage *&block, bool dirty);
+
+    virtual void add_to_indices(Handle handle, const Row &row);
+
+    virtual void unplace(const Handles &handles);
 
     virtual Dbt *marshal(const ValueDict *row);
 
     virtual ValueDict *unmarshal(Dbt *data);
+
+    virtual ValueDict *unmarshal(RecordView data);
+
+    virtual void unmarshal(RecordView data, ValueViews &values);
+
+    friend class HeapTableIterator;
+    friend class BulkLoader;
 };
 
 bool test_heap_storage();
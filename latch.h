@@ -0,0 +1,121 @@
+/**
+ * @file latch.h - Reader/writer latch guarding a page (or other in-memory structure) between threads.
+ * Latch
+ * LatchGuard
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+#include <thread>
+
+/**
+ * @class Latch - any number of shared holders, or one exclusive holder
+ *
+ *      Latches are held for as long as a block is pinned (microseconds), so a waiting thread spins,
+        yielding its core, instead of sleeping on a condition variable. A thread waiting for an
+        exclusive latch stops new shared holders from getting in, so a steady stream of readers
+        cannot starve a writer. Latches are not reentrant: a thread must not ask for a latch it
+        already holds exclusively, nor for one it holds shared while a writer may be waiting.
+ */
+class Latch {
+public:
+    Latch() : state(0) {}
+
+    virtual ~Latch() {}
+
+    Latch(const Latch &other) = delete;
+
+    Latch(Latch &&temp) = delete;
+
+    Latch &operator=(const Latch &other) = delete;
+
+    Latch &operator=(Latch &&temp) = delete;
+
+    /**
+     * Wait for the latch and take it shared
+     */
+    void lock_shared() {
+        for (uint spins = 0;; spins++) {
+            int32_t s = state.load(std::memory_order_relaxed);
+            if ((s & (EXCLUSIVE | WRITER_WAITING)) == 0
+                && state.compare_exchange_weak(s, s + 1, std::memory_order_acquire))
+                return;
+            backoff(spins);
+        }
+    }
+
+    /**
+     * Wait for the latch and take it exclusively
+     */
+    void lock() {
+        for (uint spins = 0;; spins++) {
+            int32_t s = state.load(std::memory_order_relaxed);
+            if ((s & ~WRITER_WAITING) == 0) {
+                if (state.compare_exchange_weak(s, EXCLUSIVE, std::memory_order_acquire))
+                    return;
+            } else if ((s & WRITER_WAITING) == 0) {
+                state.compare_exchange_weak(s, s | WRITER_WAITING, std::memory_order_relaxed);
+            }
+            backoff(spins);
+        }
+    }
+
+    /**
+     * Release the latch, however it is held
+     */
+    void unlock() {
+        if (state.load(std::memory_order_relaxed) & EXCLUSIVE)
+            state.fetch_and(~EXCLUSIVE, std::memory_order_release); // keeps the mark of a waiting writer
+        else
+            state.fetch_sub(1, std::memory_order_release);
+    }
+
+    /**
+     * Turn an exclusive hold into a shared one, without letting a writer in between
+     */
+    void downgrade() {
+        int32_t s = state.load(std::memory_order_relaxed);
+        while (!state.compare_exchange_weak(s, (s & WRITER_WAITING) | 1, std::memory_order_release));
+    }
+
+protected:
+    static const int32_t EXCLUSIVE = 1 << 30;
+    static const int32_t WRITER_WAITING = 1 << 29;
+
+    std::atomic<int32_t> state;     // number of shared holders, or EXCLUSIVE; plus WRITER_WAITING
+
+    static void backoff(uint spins) {
+        if (spins >= 16)
+            std::this_thread::yield();
+    }
+};
+
+/**
+ * @class LatchGuard - holds a latch for the life of a scope, like std::lock_guard
+ */
+class LatchGuard {
+public:
+    LatchGuard(Latch &latch, bool exclusive) : latch(latch) {
+        if (exclusive)
+            latch.lock();
+        else
+            latch.lock_shared();
+    }
+
+    ~LatchGuard() { latch.unlock(); }
+
+    LatchGuard(const LatchGuard &other) = delete;
+
+    LatchGuard(LatchGuard &&temp) = delete;
+
+    LatchGuard &operator=(const LatchGuard &other) = delete;
+
+    LatchGuard &operator=(LatchGuard &&temp) = delete;
+
+protected:
+    Latch &latch;
+};
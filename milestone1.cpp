@@ -1,23 +1,49 @@
 #include "../sql-parser/src/SQLParser.h"
 #include "../sql-parser/src/sqlhelper.h"
 #include "heap_storage.h"
+#include "bulk_loader.h"
+#include "btree.h"
+#include "hash_index.h"
+#include "eval_plan.h"
+#include "hash_join.h"
+#include "sort.h"
+#include "hash_aggregate.h"
+#include "plan_cache.h"
+#include "catalog.h"
+#include "wal.h"
 #include "storage_engine.h"
 // #include "heap_storage.cpp"
 #include "db_cxx.h"
 #include <iostream>
 #include <cstring>
 #include <sstream>
+#include <fstream>
+#include <map>
 #include <cstdio>
 using namespace std;
 
 const std::string QUIT = "quit";
 const unsigned int BLOCK_SZ = 4096;
 const string TEST = "test";
+const string COPY = "COPY";
+const string SHOW_CACHE = "SHOW CACHE";
+const string SHOW_STATS = "SHOW STATS";
 const char *MILESTONE1 = "milestone1.db";
+const char *WAL_FILE = "wal.log";
 DbEnv *_DB_ENV;
 
-std::string execute(hsql::SQLParserResult* query, std::string response);
+// the database's tables and indices, open from startup to quit
+Catalog* catalog;
+// parsed SELECTs and their plans, by SQL with the literals taken out (cleared when the tables change)
+PlanCache planCache;
+
+std::string execute(hsql::SQLParserResult* query, std::string response, PlanCache::Entry* entry);
 std::string parseCreate(std::string response);
+std::string createTable(const hsql::CreateStatement* createStatement);
+std::string createIndex(const hsql::CreateStatement* createStatement);
+std::string copyFrom(std::string response);
+std::string runSelect(const hsql::SelectStatement* selectStatement, PlanCache::Entry* entry, int i);
+std::string showCache();
 string parseTableRef(hsql::TableRef* tableRef);
 string parseSelect(hsql::SelectStatement* selectStatement);
 string parseExpressionWithOperator(hsql::Expr* expr);
@@ -42,7 +68,7 @@ int main(int argc, char *argv[]) {
     DbEnv env(0U);
     env.set_message_stream(&std::cout);
 	env.set_error_stream(&std::cerr);
-	env.open(envdir.c_str(), DB_CREATE | DB_INIT_MPOOL, 0);
+	env.open(envdir.c_str(), DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
 
 	Db db(&env, 0);
 	db.set_message_stream(env.get_message_stream());
@@ -51,6 +77,13 @@ int main(int argc, char *argv[]) {
 	db.open(NULL, MILESTONE1, NULL, DB_RECNO, DB_CREATE | DB_TRUNCATE, 0644);
 
     _DB_ENV = &env;
+    // what each statement changes is logged, and durable before its result is printed; if the last run
+    // did not shut down cleanly, opening the log first replays it into the tables
+    WriteAheadLog wal(envdir + "/" + WAL_FILE);
+    wal.open();
+    _DB_LOG = &wal;
+    catalog = new Catalog();
+    catalog->open();
 
     std::string response;
 
@@ -61,24 +94,71 @@ int main(int argc, char *argv[]) {
         if (response == TEST) {
             if (test_heap_storage())
                 std::cout << "Passed heap storage tests";
+            if (test_eval_plan())
+                std::cout << std::endl << "Passed eval plan tests";
+            if (test_hash_join())
+                std::cout << std::endl << "Passed hash join tests";
+            if (test_sort())
+                std::cout << std::endl << "Passed sort tests";
+            if (test_hash_aggregate())
+                std::cout << std::endl << "Passed hash aggregate tests";
+            if (test_plan_cache())
+                std::cout << std::endl << "Passed plan cache tests";
+            if (test_catalog())
+                std::cout << std::endl << "Passed catalog tests";
+            if (test_stats())
+                std::cout << std::endl << "Passed stats tests";
+            if (test_wal())
+                std::cout << std::endl << "Passed write-ahead log tests";
         }
 
-        char* responseArray = new char[response.length() + 1];
-        strcpy(responseArray, response.c_str());
+        // COPY isn't SQL the parser knows, so it's handled here like test
+        std::string firstWord = response.substr(0, response.find(' '));
+        for (char &c : firstWord)
+            c = std::toupper(c);
+        if (firstWord == COPY) {
+            std::cout << copyFrom(response) << std::endl;
+            continue;
+        }
+        std::string command = response;
+        for (char &c : command)
+            c = std::toupper(c);
+        if (command == SHOW_CACHE) {
+            std::cout << showCache() << std::endl;
+            continue;
+        }
+        if (command == SHOW_STATS) {
+            std::cout << Stats::report();
+            continue;
+        }
 
-        hsql::SQLParserResult* result = hsql::SQLParser::parseSQLString(responseArray);
+        // a statement shaped like a recent one is neither parsed nor planned again
+        PlanCache::Entry* entry = planCache.lookup(response);
+        hsql::SQLParserResult* result = entry == nullptr ? nullptr : entry->result;
+        if (result == nullptr) {
+            char* responseArray = new char[response.length() + 1];
+            strcpy(responseArray, response.c_str());
+            result = hsql::SQLParser::parseSQLString(responseArray);
+            delete [] responseArray;
+            if (result->isValid())
+                entry = planCache.insert(response, result);
+        }
 
         if (result->isValid()) {
-            std::string sql = execute(result, response);
+            std::string sql = execute(result, response, entry);
             std::cout << sql << std::endl;
         }
         else if (response != QUIT) {
             std::cout << "Invalid SQL: " << response << std::endl;
         }
 
-        delete [] responseArray;
-        delete result;
+        if (entry == nullptr)
+            delete result;
     }
+    planCache.clear();
+    delete catalog;
+    wal.checkpoint(); // so the next run has nothing to replay
+    _DB_LOG = nullptr;
 }
 
 void test_heap_storage2(){
@@ -90,7 +170,14 @@ void test_heap_storage2(){
     // file->drop();
 }
 
-std::string execute(hsql::SQLParserResult* query, std::string response) {
+/**
+ * Run the statements of a line of SQL
+ * @param query the parsed statements
+ * @param response the line
+ * @param entry the query's plan cache entry, or nullptr if it is not cached
+ * @return what to show for them
+ */
+std::string execute(hsql::SQLParserResult* query, std::string response, PlanCache::Entry* entry) {
     std::string finalQuery = "";
     int n = query->size();
 
@@ -101,16 +188,25 @@ std::string execute(hsql::SQLParserResult* query, std::string response) {
         switch(statementType){
             case hsql::kStmtCreate: // create statement
             {
+                    const hsql::CreateStatement* createStatement = (const hsql::CreateStatement*)statement;
+                    planCache.clear();
+                    if (createStatement->type == hsql::CreateStatement::kIndex) {
+                        finalQuery += createIndex(createStatement);
+                        break;
+                    }
                     finalQuery += parseCreate(response);
+                    finalQuery += createTable(createStatement);
                     break;
             }
             case hsql::kStmtSelect:{ // select statement
                 hsql::SelectStatement* selectStatement = (hsql::SelectStatement*)statement;
-                cout << parseSelect(selectStatement);               
+                finalQuery += parseSelect(selectStatement);
+                finalQuery += runSelect(selectStatement, entry, i);
                 break;
             }
         }
     }
+    _DB_LOG->commit();
     return finalQuery;
 }
 
@@ -310,4 +406,187 @@ std::string parseCreate(std::string response) {
     }
 
     return parsed;
-}
\ No newline at end of file
+}
+
+/**
+ * Create a table for a CREATE TABLE statement and record it in the catalog
+ * Tables with columns other than INT and TEXT are only echoed, not created.
+ * @param createStatement the parsed statement
+ * @return "" if all went well, otherwise an error to show after the echoed statement
+ */
+std::string createTable(const hsql::CreateStatement* createStatement) {
+    if (createStatement->type != hsql::CreateStatement::kTable)
+        return "";
+    ColumnNames columnNames;
+    ColumnAttributes columnAttributes;
+    for (hsql::ColumnDefinition* column : *createStatement->columns) {
+        columnNames.push_back(column->name);
+        if (column->type == hsql::ColumnDefinition::INT)
+            columnAttributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+        else if (column->type == hsql::ColumnDefinition::TEXT)
+            columnAttributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+        else
+            return "";
+    }
+
+    try {
+        catalog->create_table(createStatement->tableName, columnNames, columnAttributes);
+    } catch (DbRelationError &e) {
+        return std::string("\n") + e.what();
+    }
+    return "";
+}
+
+/**
+ * Build an index on a table and record it in the catalog: CREATE INDEX name ON table [USING BTREE | HASH] (column)
+ * @param createStatement the parsed statement
+ * @return the statement, followed by an error if the index could not be built
+ */
+std::string createIndex(const hsql::CreateStatement* createStatement) {
+    std::string indexName = createStatement->indexName;
+    std::string tableName = createStatement->tableName;
+    std::string indexType = createStatement->indexType == nullptr ? "BTREE" : createStatement->indexType;
+    for (char &c : indexType)
+        c = std::toupper(c);
+    ColumnNames keyColumns;
+    std::string parsed = "CREATE INDEX " + indexName + " ON " + tableName + " USING " + indexType + " (";
+    for (char* column : *createStatement->indexColumns) {
+        parsed += (keyColumns.empty() ? "" : ", ") + std::string(column);
+        keyColumns.push_back(column);
+    }
+    parsed += ")";
+
+    try {
+        catalog->create_index(tableName, indexName, indexType, keyColumns);
+    } catch (DbRelationError &e) {
+        return parsed + "\n" + e.what();
+    }
+    return parsed;
+}
+
+/**
+ * Bulk load a delimited file into a table: COPY table FROM 'path' [CSV | TSV] [HEADER]
+ * CSV (the default) is comma-separated with optional double quotes, TSV is tab-separated without quotes.
+ * @param response the command as typed
+ * @return how many rows were loaded, or what went wrong
+ */
+std::string copyFrom(std::string response) {
+    const std::string usage = "Usage: COPY table FROM 'path' [CSV | TSV] [HEADER]";
+    std::stringstream ss(response);
+    std::string temp, tableName, from, path;
+    ss >> temp >> tableName >> from >> path;
+    for (char &c : from)
+        c = std::toupper(c);
+    if (from != "FROM" || path.empty())
+        return usage;
+    if (path.size() >= 2 && path.front() == '\'' && path.back() == '\'')
+        path = path.substr(1, path.size() - 2);
+
+    char delimiter = ',';
+    bool quoted = true;
+    bool header = false;
+    while (ss >> temp) {
+        for (char &c : temp)
+            c = std::toupper(c);
+        if (temp == "CSV") {
+            delimiter = ',';
+            quoted = true;
+        } else if (temp == "TSV") {
+            delimiter = '\t';
+            quoted = false;
+        } else if (temp == "HEADER") {
+            header = true;
+        } else {
+            return usage;
+        }
+    }
+
+    HeapTable* table = catalog->get_table(tableName);
+    if (table == nullptr)
+        return "No table " + tableName;
+    std::ifstream in(path);
+    if (!in)
+        return "Cannot open " + path;
+    BulkLoader loader(*table, delimiter, quoted);
+    try {
+        u_int64_t n = loader.load(in, header);
+        _DB_LOG->commit();
+        _DB_LOG->checkpoint(); // the load logged every page it wrote: put them in the files instead of leaving them to replay
+        return "COPY " + std::to_string(n);
+    } catch (DbRelationError &e) {
+        return std::string("Error: ") + e.what();
+    }
+}
+
+/**
+ * Run a SELECT against the catalog's tables
+ * @param selectStatement the parsed statement
+ * @param entry its plan cache entry, to reuse the plan built the first time it ran (or nullptr)
+ * @param i which of the entry's statements it is
+ * @return the rows as lines below a header, then the row count; or why it could not be run
+ */
+std::string runSelect(const hsql::SelectStatement* selectStatement, PlanCache::Entry* entry, int i) {
+    EvalPlan* plan = entry == nullptr ? nullptr : entry->plans[i];
+    if (plan == nullptr) {
+        try {
+            plan = plan_select(selectStatement, catalog->get_tables(), entry == nullptr ? nullptr : &entry->bindings);
+        } catch (PlanError &e) {
+            return std::string("\n") + e.what();
+        } catch (DbRelationError &e) {
+            return std::string("\n") + e.what();
+        }
+        if (entry != nullptr)
+            entry->plans[i] = plan;
+    }
+
+    std::stringstream out;
+    out << std::endl;
+    for (const Identifier &columnName : plan->get_column_names())
+        out << columnName << " ";
+    out << std::endl << "+";
+    for (uint i = 0; i < plan->get_column_names().size(); i++)
+        out << "----------+";
+    out << std::endl;
+    u_int64_t n = 0;
+    try {
+        RowBatch batch;
+        plan->open();
+        while (plan->next(batch)) {
+            for (uint i = 0; i < batch.size(); i++) {
+                for (uint col_num = 0; col_num < batch[i].size(); col_num++) {
+                    ValueView value = batch[i].get(col_num);
+                    if (value.data_type == ColumnAttribute::INT)
+                        out << value.n << " ";
+                    else
+                        out << "\"" << value.str() << "\" ";
+                }
+                out << std::endl;
+            }
+            n += batch.size();
+        }
+        plan->close();
+    } catch (DbRelationError &e) {
+        delete plan;
+        if (entry != nullptr)
+            entry->plans[i] = nullptr;
+        return std::string("\n") + e.what();
+    }
+    if (entry == nullptr)
+        delete plan;
+    out << n << (n == 1 ? " row" : " rows");
+    return out.str();
+}
+
+/**
+ * Report on the plan cache: SHOW CACHE
+ * @return its size and how often lookups have found a statement in it
+ */
+std::string showCache() {
+    u_int64_t hits = planCache.get_hits(), lookups = hits + planCache.get_misses();
+    std::stringstream out;
+    out << "Plan cache: " << planCache.size() << " of " << planCache.get_capacity() << " entries, "
+        << hits << " hits, " << planCache.get_misses() << " misses";
+    if (lookups > 0)
+        out << " (" << 100 * hits / lookups << "% hit rate)";
+    return out.str();
+}
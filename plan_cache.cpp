@@ -0,0 +1,403 @@
+#include "plan_cache.h"
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * @class PlanCache
+ *
+ * Parsed SELECT statements and their plans, looked up by their SQL with the literals taken out.
+ */
+
+PlanCache::PlanCache(size_t capacity) : capacity(capacity), entries(), index(), hits(0), misses(0) {
+}
+
+PlanCache::~PlanCache() {
+    clear();
+}
+
+/**
+ * Whether a minus after this word is a sign rather than a subtraction
+ * @param word the word, in upper case
+ */
+static bool sign_follows(const std::string &word) {
+    return word == "SELECT" || word == "WHERE" || word == "AND" || word == "OR" || word == "NOT" || word == "ON"
+           || word == "HAVING";
+}
+
+bool PlanCache::normalize(const std::string &sql, std::string &key, Parameters &params) {
+    enum Token {
+        START, WORD, VALUE, OTHER
+    };
+    key.clear();
+    params.clear();
+    Token previous = START;
+    std::string word;   // the previous token, if it was a word (in upper case)
+    size_t i = 0, n = sql.size();
+    while (i < n) {
+        char c = sql[i];
+        if (std::isspace((unsigned char) c)) {
+            while (i < n && std::isspace((unsigned char) sql[i]))
+                i++;
+            if (!key.empty())
+                key += ' ';
+            continue;
+        }
+        if (c == '\'' || c == '"') {
+            size_t end = sql.find(c, i + 1);
+            if (end == std::string::npos)
+                return false;
+            if (c == '\'') {
+                params.push_back(Value(sql.substr(i + 1, end - i - 1)));
+                key += "'?'";
+            } else {
+                key += sql.substr(i, end + 1 - i);
+            }
+            i = end + 1;
+            previous = VALUE;
+            continue;
+        }
+        if (std::isalpha((unsigned char) c) || c == '_') {
+            size_t start = i;
+            while (i < n && (std::isalnum((unsigned char) sql[i]) || sql[i] == '_'))
+                i++;
+            key += sql.substr(start, i - start);
+            word = sql.substr(start, i - start);
+            for (char &w : word)
+                w = (char) std::toupper(w);
+            previous = WORD;
+            continue;
+        }
+        bool sign = c == '-' && i + 1 < n && std::isdigit((unsigned char) sql[i + 1])
+                    && (previous == START || previous == OTHER || (previous == WORD && sign_follows(word)));
+        if (std::isdigit((unsigned char) c) || sign) {
+            size_t start = i++;
+            while (i < n && std::isdigit((unsigned char) sql[i]))
+                i++;
+            bool integer = i == n || !(std::isalnum((unsigned char) sql[i]) || sql[i] == '_' || sql[i] == '.');
+            while (i < n && (std::isalnum((unsigned char) sql[i]) || sql[i] == '_' || sql[i] == '.'))
+                i++;
+            std::string number = sql.substr(start, i - start);
+            bool shapes_plan = previous == WORD && (word == "LIMIT" || word == "OFFSET");
+            if (integer && !shapes_plan && number.size() <= 11) {
+                long long value = std::stoll(number);
+                if (value >= INT32_MIN && value <= INT32_MAX) {
+                    params.push_back(Value((int32_t) value));
+                    number = "?";
+                }
+            }
+            key += number;
+            previous = VALUE;
+            continue;
+        }
+        if (c == '?')
+            return false;   // a placeholder would look like a parameter
+        key += c;
+        i++;
+        previous = c == ')' ? VALUE : OTHER;
+    }
+    if (!key.empty() && key.back() == ' ')
+        key.pop_back();
+    return true;
+}
+
+/**
+ * Find the literals of an expression that normalize() makes parameters, in the order of the text
+ * @param expr the expression
+ * @param slots the literals (or negations of INT literals) are appended to this
+ * @param values their values are appended to this
+ * @return false if the expression has operators whose operands are not in text order (so it is not cached)
+ */
+static bool literals(hsql::Expr *expr, std::vector<hsql::Expr *> &slots, Parameters &values) {
+    switch (expr->type) {
+        case hsql::kExprLiteralInt:
+            if (expr->ival >= INT32_MIN && expr->ival <= INT32_MAX) {
+                slots.push_back(expr);
+                values.push_back(Value((int32_t) expr->ival));
+            }
+            return true;
+        case hsql::kExprLiteralString:
+            slots.push_back(expr);
+            values.push_back(Value(std::string(expr->name)));
+            return true;
+        case hsql::kExprLiteralFloat:
+        case hsql::kExprColumnRef:
+        case hsql::kExprStar:
+            return true;
+        case hsql::kExprFunctionRef:
+            if (expr->exprList != nullptr)
+                for (hsql::Expr *arg : *expr->exprList)
+                    if (!literals(arg, slots, values))
+                        return false;
+            return true;
+        case hsql::kExprOperator:
+            switch (expr->opType) {
+                case hsql::Expr::UMINUS:
+                    if (expr->expr->type == hsql::kExprLiteralInt && -expr->expr->ival >= INT32_MIN
+                        && -expr->expr->ival <= INT32_MAX) {
+                        slots.push_back(expr);
+                        values.push_back(Value((int32_t) -expr->expr->ival));
+                        return true;
+                    }
+                    return literals(expr->expr, slots, values);
+                case hsql::Expr::SIMPLE_OP:
+                case hsql::Expr::NOT_EQUALS:
+                case hsql::Expr::LESS_EQ:
+                case hsql::Expr::GREATER_EQ:
+                case hsql::Expr::AND:
+                case hsql::Expr::OR:
+                case hsql::Expr::NOT:
+                    return (expr->expr == nullptr || literals(expr->expr, slots, values))
+                           && (expr->expr2 == nullptr || literals(expr->expr2, slots, values));
+                default:
+                    return false;
+            }
+        default:
+            return false;
+    }
+}
+
+/**
+ * Find the literals of a FROM clause, in the order of the text
+ * @see literals(hsql::Expr *, ...)
+ */
+static bool literals(hsql::TableRef *from, std::vector<hsql::Expr *> &slots, Parameters &values) {
+    switch (from->type) {
+        case hsql::kTableName:
+            return true;
+        case hsql::kTableJoin:
+            return literals(from->join->left, slots, values) && literals(from->join->right, slots, values)
+                   && (from->join->condition == nullptr || literals(from->join->condition, slots, values));
+        default:
+            return false;
+    }
+}
+
+/**
+ * Find the literals of a SELECT statement, in the order of the text
+ * @see literals(hsql::Expr *, ...)
+ */
+static bool literals(hsql::SelectStatement *select, std::vector<hsql::Expr *> &slots, Parameters &values) {
+    if (select->unionSelect != nullptr || select->fromTable == nullptr)
+        return false;
+    for (hsql::Expr *expr : *select->selectList)
+        if (!literals(expr, slots, values))
+            return false;
+    if (!literals(select->fromTable, slots, values))
+        return false;
+    if (select->whereClause != nullptr && !literals(select->whereClause, slots, values))
+        return false;
+    if (select->groupBy != nullptr) {
+        for (hsql::Expr *expr : *select->groupBy->columns)
+            if (!literals(expr, slots, values))
+                return false;
+        if (select->groupBy->having != nullptr && !literals(select->groupBy->having, slots, values))
+            return false;
+    }
+    if (select->order != nullptr)
+        for (hsql::OrderDescription *order : *select->order)
+            if (!literals(order->expr, slots, values))
+                return false;
+    return true;
+}
+
+static bool same_value(const Value &a, const Value &b) {
+    return a.data_type == b.data_type && (a.data_type == ColumnAttribute::INT ? a.n == b.n : a.s == b.s);
+}
+
+/**
+ * Find a statement with the same shape as some SQL, bound to the SQL's literals
+ * @param sql the SQL
+ * @return the entry (owned by the cache, and valid until the next insert() or clear()), or nullptr
+ */
+PlanCache::Entry *PlanCache::lookup(const std::string &sql) {
+    std::string key;
+    Parameters params;
+    if (!normalize(sql, key, params)) {
+        misses++;
+        return nullptr;
+    }
+    std::unordered_map<std::string, Entries::iterator>::iterator found = index.find(key);
+    if (found == index.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, found->second);
+    Entry *entry = *found->second;
+    bind(entry, params);
+    return entry;
+}
+
+/**
+ * Cache the parsed statements of some SQL that missed in lookup()
+ * @param sql the SQL
+ * @param result its parse (owned by the cache if it is cached)
+ * @return the new entry (valid until the next insert() or clear()), or nullptr if the statements
+ *         cannot be cached (so result is still the caller's)
+ */
+PlanCache::Entry *PlanCache::insert(const std::string &sql, hsql::SQLParserResult *result) {
+    std::string key;
+    Parameters params;
+    if (capacity == 0 || result->size() == 0 || !normalize(sql, key, params))
+        return nullptr;
+    std::vector<hsql::Expr *> slots;
+    Parameters values;
+    for (size_t i = 0; i < result->size(); i++) {
+        hsql::SQLStatement *statement = result->getMutableStatement(i);
+        if (statement->type() != hsql::kStmtSelect
+            || !literals((hsql::SelectStatement *) statement, slots, values))
+            return nullptr;
+    }
+    if (values.size() != params.size())
+        return nullptr;
+    for (size_t i = 0; i < values.size(); i++)
+        if (!same_value(values[i], params[i]))
+            return nullptr;
+
+    std::unordered_map<std::string, Entries::iterator>::iterator found = index.find(key);
+    if (found != index.end()) {
+        free_entry(*found->second);
+        entries.erase(found->second);
+        index.erase(found);
+    }
+    Entry *entry = new Entry{key, result, std::vector<EvalPlan *>(result->size(), nullptr), params, slots,
+                             Bindings()};
+    entry->bindings.params = &entry->params;
+    for (uint i = 0; i < slots.size(); i++)
+        entry->bindings.slots[slots[i]] = i;
+    entries.push_front(entry);
+    index[key] = entries.begin();
+    while (entries.size() > capacity) {
+        index.erase(entries.back()->key);
+        free_entry(entries.back());
+        entries.pop_back();
+    }
+    return entry;
+}
+
+/**
+ * Drop every entry (e.g. when the tables change), keeping the hit and miss counts
+ */
+void PlanCache::clear() {
+    for (Entry *entry : entries)
+        free_entry(entry);
+    entries.clear();
+    index.clear();
+}
+
+/**
+ * Write new values for a cached statement's literals into its AST and its parameters
+ * @param entry the cached statement
+ * @param params the values, which have the types of the ones the statement has now
+ */
+void PlanCache::bind(Entry *entry, const Parameters &params) {
+    for (size_t i = 0; i < params.size(); i++) {
+        hsql::Expr *slot = entry->slots[i];
+        if (slot->type == hsql::kExprLiteralInt) {
+            slot->ival = params[i].n;
+        } else if (slot->type == hsql::kExprOperator) {
+            slot->expr->ival = -(int64_t) params[i].n;
+        } else {
+            free(slot->name);
+            slot->name = strdup(params[i].s.c_str());
+        }
+        entry->params[i] = params[i];
+    }
+}
+
+void PlanCache::free_entry(Entry *entry) {
+    for (EvalPlan *plan : entry->plans)
+        delete plan;
+    delete entry->result;
+    delete entry;
+}
+
+/**
+ * Run some SQL through a cache as the REPL does, planning a cached statement only the first time
+ * @return the number of rows, or -1 if the SQL does not parse, -2 if it cannot be cached
+ */
+static int run_cached(PlanCache &cache, const Tables &tables, const std::string &sql) {
+    PlanCache::Entry *entry = cache.lookup(sql);
+    if (entry == nullptr) {
+        hsql::SQLParserResult *result = hsql::SQLParser::parseSQLString(sql);
+        if (!result->isValid()) {
+            delete result;
+            return -1;
+        }
+        entry = cache.insert(sql, result);
+        if (entry == nullptr) {
+            delete result;
+            return -2;
+        }
+    }
+    if (entry->plans[0] == nullptr)
+        entry->plans[0] = plan_select((const hsql::SelectStatement *) entry->result->getStatement(0), tables,
+                                      &entry->bindings);
+    int n = 0;
+    RowBatch batch;
+    entry->plans[0]->open();
+    while (entry->plans[0]->next(batch))
+        n += batch.size();
+    entry->plans[0]->close();
+    return n;
+}
+
+bool test_plan_cache() {
+    std::string key;
+    Parameters params;
+    bool ok = PlanCache::normalize("SELECT  a, b\tFROM t1 WHERE a = 12 AND b <> 'x  y'", key, params)
+              && key == "SELECT a, b FROM t1 WHERE a = ? AND b <> '?'" && params.size() == 2
+              && params[0].n == 12 && params[1].s == "x  y";
+    ok = ok && PlanCache::normalize("SELECT * FROM t WHERE a=-5 AND (b > 2-1) AND -3 < a", key, params)
+         && key == "SELECT * FROM t WHERE a=? AND (b > ?-?) AND ? < a" && params.size() == 4
+         && params[0].n == -5 && params[1].n == 2 && params[2].n == 1 && params[3].n == -3;
+    ok = ok && PlanCache::normalize("SELECT * FROM \"t 2\" WHERE a > 3000000000 OR a = 1.5 LIMIT 10 OFFSET 5",
+                                    key, params)
+         && key == "SELECT * FROM \"t 2\" WHERE a > 3000000000 OR a = 1.5 LIMIT 10 OFFSET 5" && params.empty();
+    ok = ok && !PlanCache::normalize("SELECT * FROM t WHERE b = 'open", key, params)
+         && !PlanCache::normalize("SELECT * FROM t WHERE a = ?", key, params);
+    if (!ok) {
+        std::cout << "plan cache did not normalize SQL right" << std::endl;
+        return false;
+    }
+
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_plan_cache_cpp", column_names, column_attributes);
+    table.create();
+    Rows rows(100, Row(&table.get_column_names()));
+    for (int i = 0; i < 100; i++) {
+        rows[i].set(0, i);
+        rows[i].set(1, i % 2 == 0 ? "even" : "odd");
+    }
+    delete table.insert_batch(rows);
+    Tables tables;
+    tables["_test_plan_cache_cpp"] = &table;
+
+    PlanCache cache(2);
+    ok = run_cached(cache, tables, "SELECT a FROM _test_plan_cache_cpp WHERE a < 10 AND b = 'odd'") == 5
+         && run_cached(cache, tables, "SELECT a FROM _test_plan_cache_cpp WHERE a < 50 AND b = 'even'") == 25
+         && run_cached(cache, tables, "SELECT  a FROM _test_plan_cache_cpp WHERE a < -1 AND b = 'odd'") == 0
+         && cache.get_hits() == 2 && cache.get_misses() == 1 && cache.size() == 1;
+    PlanCache::Entry *entry = cache.lookup("SELECT a FROM _test_plan_cache_cpp WHERE a < 7 AND b = 'x'");
+    ok = ok && entry != nullptr && entry->params[0].n == 7;
+    ok = ok && run_cached(cache, tables, "SELECT b FROM _test_plan_cache_cpp WHERE a >= 90") == 10
+         && run_cached(cache, tables, "SELECT * FROM _test_plan_cache_cpp") == 100
+         && cache.lookup("SELECT a FROM _test_plan_cache_cpp WHERE a < 1 AND b = 'odd'") == nullptr
+         && cache.size() == 2;
+    hsql::SQLParserResult *result = hsql::SQLParser::parseSQLString("CREATE TABLE t (a INT)");
+    ok = ok && cache.insert("CREATE TABLE t (a INT)", result) == nullptr;
+    delete result;
+    cache.clear();
+    ok = ok && cache.size() == 0 && cache.lookup("SELECT * FROM _test_plan_cache_cpp") == nullptr;
+    if (!ok)
+        std::cout << "plan cache did not reuse the right statements" << std::endl;
+    table.drop();
+    return ok;
+}
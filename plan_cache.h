@@ -0,0 +1,96 @@
+/**
+ * @file plan_cache.h - LRU cache of parsed statements and their plans, keyed by normalized SQL.
+ * PlanCache
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include "eval_plan.h"
+
+/**
+ * @class PlanCache - the parsed statements of recently run SQL, and the plans built from them
+ *
+ *      A statement is looked up by its text with its literals taken out (see normalize()), so
+        SELECT * FROM t WHERE a = 1 and SELECT * FROM t WHERE a = 2 share an entry. On a hit the new
+        literals are written into the cached AST (so it reads as the statement typed) and into the
+        entry's Parameters, which the entry's plans read each time they are opened; the statement
+        is neither parsed nor planned again.
+
+        Only SELECT statements are cached, and only those whose literals the AST walk can match
+        one for one with the ones in the text. The least recently used entry is dropped when the
+        cache is full. Plans name tables directly, so the cache is to be cleared when the tables or
+        their indices change.
+ */
+class PlanCache {
+public:
+    static const size_t DEFAULT_CAPACITY = 64;
+
+    /**
+     * @class Entry - a cached statement: its AST, its plans (built on first use) and its parameters
+     */
+    struct Entry {
+        std::string key;
+        hsql::SQLParserResult *result;
+        std::vector<EvalPlan *> plans;          // of each statement in result, or nullptr until planned
+        Parameters params;                      // of the statement the entry was last looked up for
+        std::vector<hsql::Expr *> slots;        // the literal (or negated INT literal) of each parameter
+        Bindings bindings;                      // what plans are built with
+    };
+
+    PlanCache(size_t capacity = DEFAULT_CAPACITY);
+
+    virtual ~PlanCache();
+
+    PlanCache(const PlanCache &other) = delete;
+
+    PlanCache(PlanCache &&temp) = delete;
+
+    PlanCache &operator=(const PlanCache &other) = delete;
+
+    PlanCache &operator=(PlanCache &&temp) = delete;
+
+    virtual Entry *lookup(const std::string &sql);
+
+    virtual Entry *insert(const std::string &sql, hsql::SQLParserResult *result);
+
+    virtual void clear(void);
+
+    virtual size_t size() const { return entries.size(); }
+
+    virtual size_t get_capacity() const { return capacity; }
+
+    virtual u_int64_t get_hits() const { return hits; }
+
+    virtual u_int64_t get_misses() const { return misses; }
+
+    /**
+     * Normalize SQL into a cache key
+     *      Runs of whitespace become one space. Each 'string' becomes '?' and each integer that
+            fits an INT (with its sign, when the minus cannot be a subtraction) becomes ?; their
+            values are the parameters, in order. Other numbers, those after LIMIT and OFFSET (which
+            shape the plan) and "identifiers" are kept as they are.
+     * @param sql     the SQL
+     * @param key     set to the key
+     * @param params  set to the literals taken out of it
+     * @return false if it cannot be normalized (an unterminated quote)
+     */
+    static bool normalize(const std::string &sql, std::string &key, Parameters &params);
+
+protected:
+    typedef std::list<Entry *> Entries;
+
+    size_t capacity;
+    Entries entries;                        // most recently used first
+    std::unordered_map<std::string, Entries::iterator> index;
+    u_int64_t hits;
+    u_int64_t misses;
+
+    virtual void bind(Entry *entry, const Parameters &params);
+
+    static void free_entry(Entry *entry);
+};
+
+bool test_plan_cache();
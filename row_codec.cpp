@@ -0,0 +1,112 @@
+#include "row_codec.h"
+#include "heap_storage.h"
+#include <cstring>
+
+/**
+ * @class RowCodec
+ *
+ * Precomputed record layout for one table's columns.
+ */
+
+/**
+ * Lay out the fixed section for a table's columns
+ * @param column_attributes the table's column attributes, in column order
+ * @throws DbRelationError if a column is not INT or TEXT
+ */
+RowCodec::RowCodec(const ColumnAttributes &column_attributes) : types(), offsets(), prev_text(), fixed_size(0) {
+    int last_text = -1;
+    for (ColumnAttribute ca : column_attributes) {
+        ColumnAttribute::DataType data_type = ca.get_data_type();
+        types.push_back(data_type);
+        offsets.push_back(fixed_size);
+        prev_text.push_back(last_text);
+        if (data_type == ColumnAttribute::DataType::INT) {
+            fixed_size += sizeof(int32_t);
+        } else if (data_type == ColumnAttribute::DataType::TEXT) {
+            fixed_size += sizeof(u_int16_t);
+            last_text = (int) types.size() - 1;
+        } else {
+            throw DbRelationError("Only know how to marshal INT and TEXT");
+        }
+    }
+}
+
+/**
+ * How many bytes a row takes once encoded
+ * @param row the row's values, in column order
+ * @return the encoded size
+ * @throws DbRelationError if the row could never fit in a block
+ */
+u_int16_t RowCodec::encoded_size(const Row &row) const {
+    size_t size = fixed_size;
+    for (uint col_num = 0; col_num < types.size(); col_num++) {
+        if (types[col_num] == ColumnAttribute::DataType::TEXT)
+            size += row.get(col_num).s_size;
+    }
+    if (size > SlottedPage::MAX_RECORD_SZ)
+        throw DbRelationError("Row is too big to fit in a block");
+    return (u_int16_t) size;
+}
+
+/**
+ * Encode a row
+ * @param row the row's values, in column order
+ * @param dest encoded_size(row) bytes to write the record to (e.g. space reserved in a block)
+ */
+void RowCodec::encode(const Row &row, char *dest) const {
+    u_int16_t end = fixed_size;
+    for (uint col_num = 0; col_num < types.size(); col_num++) {
+        ValueView value = row.get(col_num);
+        if (types[col_num] == ColumnAttribute::DataType::INT) {
+            *(int32_t *) (dest + offsets[col_num]) = value.n;
+        } else {
+            u_int16_t size = value.s_size;
+            memcpy(dest + end, value.s, size); // assume ascii for now
+            end += size;
+            *(u_int16_t *) (dest + offsets[col_num]) = end;
+        }
+    }
+}
+
+/**
+ * Decode every column of a record without copying
+ * @param record the encoded record
+ * @param values filled in with one view per column (reusing its storage)
+ */
+void RowCodec::decode(RecordView record, ValueViews &values) const {
+    values.resize(types.size());
+    for (uint col_num = 0; col_num < types.size(); col_num++)
+        values[col_num] = decode(record, col_num);
+}
+
+/**
+ * Decode every column of a record into a Row, copying the TEXT bytes so the row outlives the block
+ * @param record the encoded record
+ * @param row cleared and filled in, in column order (must already have this table's columns)
+ */
+void RowCodec::decode(RecordView record, Row &row) const {
+    row.clear();
+    for (uint col_num = 0; col_num < types.size(); col_num++)
+        row.set(col_num, decode(record, col_num));
+}
+
+/**
+ * Decode one column of a record without copying
+ * @param record the encoded record
+ * @param col_num which column
+ * @return the column's value (TEXT points into the record)
+ */
+ValueView RowCodec::decode(RecordView record, uint col_num) const {
+    ValueView value;
+    value.data_type = types[col_num];
+    if (value.data_type == ColumnAttribute::DataType::INT) {
+        value.n = *(const int32_t *) (record.data + offsets[col_num]);
+    } else {
+        u_int16_t start = prev_text[col_num] < 0 ? fixed_size
+                                                 : *(const u_int16_t *) (record.data + offsets[prev_text[col_num]]);
+        u_int16_t end = *(const u_int16_t *) (record.data + offsets[col_num]);
+        value.s = record.data + start;
+        value.s_size = end - start;
+    }
+    return value;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file row_codec.h - On-block record format for HeapTable rows.
+ * RowCodec
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <vector>
+#include "storage_engine.h"
+
+/**
+ * @class RowCodec - encodes and decodes rows for one table's schema
+ *
+ *      Built once per table, so encoding and decoding are straight loops over precomputed arrays
+        with no per-column lookups. A record is laid out as:
+            fixed section: one slot per column, in column order
+                INT:  the 4-byte value
+                TEXT: 2-byte offset (from the start of the record) to the end of the column's bytes
+            variable section: the bytes of every TEXT column, in column order
+        Every column is at a fixed offset, and a TEXT column starts where the previous TEXT column
+        ends (or at the end of the fixed section), so any single column can be decoded in O(1).
+ */
+class RowCodec {
+public:
+    RowCodec(const ColumnAttributes &column_attributes);
+
+    virtual ~RowCodec() {}
+
+    virtual u_int16_t get_fixed_size() const { return fixed_size; }
+
+    virtual u_int16_t encoded_size(const Row &row) const;
+
+    virtual void encode(const Row &row, char *dest) const;
+
+    virtual void decode(RecordView record, ValueViews &values) const;
+
+    virtual void decode(RecordView record, Row &row) const;
+
+    virtual ValueView decode(RecordView record, uint col_num) const;
+
+protected:
+    std::vector<ColumnAttribute::DataType> types;
+    std::vector<u_int16_t> offsets;     // offset of each column's slot in the fixed section
+    std::vector<int> prev_text;         // previous TEXT column, or -1 if the variable section starts here
+    u_int16_t fixed_size;
+};
@@ -0,0 +1,410 @@
+#include "sort.h"
+#include <algorithm>
+
+/**
+ * @class Sort
+ *
+ * Orders its input's rows by normalized keys, in memory when they fit and by merging sorted runs
+ * written to temporary files when they do not.
+ */
+
+/**
+ * Order of entries: by key, then by position in the input
+ */
+static bool entry_less(const std::string &a_key, u_int64_t a_seq, const std::string &b_key, u_int64_t b_seq) {
+    int cmp = a_key.compare(b_key);
+    return cmp < 0 || (cmp == 0 && a_seq < b_seq);
+}
+
+/**
+ * @param input the rows to sort (owned)
+ * @param keys the columns to sort by, most significant first
+ * @param limit how many of the first rows are wanted (e.g. for ORDER BY ... LIMIT)
+ * @param memory_budget bytes of rows to hold in memory before writing a sorted run
+ */
+Sort::Sort(EvalPlan *input, SortKeys keys, u_int64_t limit, size_t memory_budget) : input(input), keys(keys),
+            limit(limit), memory_budget(memory_budget), entries(), entry_bytes(0), position(0), runs(), heap(),
+            current(nullptr), returned(0), runs_made(0) {
+}
+
+Sort::~Sort() {
+    clear();
+    delete input;
+}
+
+/**
+ * Read all of the input, leaving it sorted in memory or in runs ready to be merged
+ */
+void Sort::open() {
+    clear();
+    runs_made = 0;
+    input->open();
+    bool top_n = limit != UINT64_MAX;
+    u_int64_t seq = 0;
+    std::string key;
+    RowBatch batch;
+    while (limit > 0 && input->next(batch)) {
+        for (uint i = 0; i < batch.size(); i++) {
+            normalize(batch[i], keys, key);
+            if (top_n) {
+                add_top_n(batch[i], key, seq++);
+                top_n = entry_bytes <= memory_budget; // else the heap's rows are the first run's
+            } else {
+                entries.push_back(Entry{key, seq++, batch[i]});
+                entry_bytes += row_bytes(batch[i]) + key.size();
+                if (entry_bytes > memory_budget)
+                    write_run();
+            }
+        }
+    }
+    if (runs.empty()) {
+        sort_entries();
+    } else {
+        if (!entries.empty())
+            write_run();
+        merge_runs();
+        start_merge(0, runs.size());
+    }
+}
+
+/**
+ * Get the next rows in order
+ * @param batch filled with the next rows
+ * @return false when there are no more
+ */
+bool Sort::next(RowBatch &batch) {
+    batch.clear();
+    const ColumnNames *names = &get_column_names();
+    while (!batch.full() && returned < limit) {
+        const Row *row;
+        if (runs.empty()) {
+            if (position >= entries.size())
+                break;
+            row = &entries[position++].row;
+        } else if (!next_merged(row)) {
+            break;
+        }
+        Row &out = batch.add(names);
+        for (uint col_num = 0; col_num < names->size(); col_num++)
+            out.set(col_num, *row, col_num);
+        returned++;
+    }
+    return !batch.empty();
+}
+
+void Sort::close() {
+    input->close();
+    clear();
+}
+
+void Sort::normalize(const Row &row, const SortKeys &keys, std::string &key) {
+    key.clear();
+    for (const SortKey &sort_key : keys) {
+        size_t start = key.size();
+        if (row.is_null(sort_key.col_num)) {
+            key.push_back('\0');
+        } else {
+            key.push_back('\1');
+            ValueView value = row.get(sort_key.col_num);
+            if (value.data_type == ColumnAttribute::INT) {
+                u_int32_t n = (u_int32_t) value.n ^ 0x80000000u;
+                for (int shift = 24; shift >= 0; shift -= 8)
+                    key.push_back((char) (n >> shift));
+            } else {
+                for (u_int32_t i = 0; i < value.s_size; i++) {
+                    key.push_back(value.s[i]);
+                    if (value.s[i] == '\0')
+                        key.push_back('\xff');
+                }
+                key.append(2, '\0');
+            }
+        }
+        if (sort_key.descending)
+            for (size_t i = start; i < key.size(); i++)
+                key[i] = (char) ~key[i];
+    }
+}
+
+/**
+ * Offer a row to the top-N heap: it goes in if there are fewer than limit rows or it beats the worst
+ * @param row the row
+ * @param key its normalized key
+ * @param seq its position in the input
+ */
+void Sort::add_top_n(const Row &row, const std::string &key, u_int64_t seq) {
+    auto less = [](const Entry &a, const Entry &b) { return entry_less(a.key, a.seq, b.key, b.seq); };
+    if (entries.size() < limit) {
+        entries.push_back(Entry{key, seq, row});
+        entry_bytes += row_bytes(row) + key.size();
+        std::push_heap(entries.begin(), entries.end(), less);
+        return;
+    }
+    if (key.compare(entries.front().key) >= 0)
+        return; // no better than the worst kept (which also came first)
+    std::pop_heap(entries.begin(), entries.end(), less);
+    Entry &worst = entries.back();
+    entry_bytes -= row_bytes(worst.row) + worst.key.size();
+    worst.key = key;
+    worst.seq = seq;
+    worst.row = row;
+    entry_bytes += row_bytes(row) + key.size();
+    std::push_heap(entries.begin(), entries.end(), less);
+}
+
+void Sort::sort_entries(void) {
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return entry_less(a.key, a.seq, b.key, b.seq); });
+}
+
+/**
+ * Sort the rows in memory and write them (at most limit of them) to a new run
+ */
+void Sort::write_run(void) {
+    sort_entries();
+    SpillFile *run = new SpillFile(input->get_column_attributes());
+    runs.push_back(run);
+    runs_made++;
+    for (size_t i = 0; i < entries.size() && i < limit; i++)
+        run->append(entries[i].row);
+    run->rewind();
+    entries.clear();
+    entry_bytes = 0;
+}
+
+/**
+ * Merge the runs MAX_FAN_IN at a time until there are no more than MAX_FAN_IN of them
+ */
+void Sort::merge_runs(void) {
+    while (runs.size() > MAX_FAN_IN) {
+        std::vector<SpillFile *> merged;
+        try {
+            for (size_t first = 0; first < runs.size(); first += MAX_FAN_IN) {
+                size_t last = std::min(first + MAX_FAN_IN, runs.size());
+                if (last - first == 1) {
+                    merged.push_back(runs[first]);
+                    runs[first] = nullptr;
+                } else {
+                    merged.push_back(merge(first, last));
+                }
+            }
+        } catch (...) {
+            for (SpillFile *run : merged)
+                delete run;
+            throw;
+        }
+        for (SpillFile *run : runs)
+            delete run;
+        runs.swap(merged);
+    }
+}
+
+/**
+ * Merge some consecutive runs into a new one
+ * @param first the first run
+ * @param last one past the last
+ * @return the new run (freed by caller)
+ */
+SpillFile *Sort::merge(size_t first, size_t last) {
+    SpillFile *run = new SpillFile(input->get_column_attributes());
+    try {
+        start_merge(first, last);
+        const Row *row;
+        for (u_int64_t n = 0; n < limit && next_merged(row); n++)
+            run->append(*row);
+        run->rewind();
+    } catch (...) {
+        delete run;
+        throw;
+    }
+    return run;
+}
+
+/**
+ * Position a cursor on the first row of each of some consecutive runs and heap them
+ * @param first the first run
+ * @param last one past the last
+ */
+void Sort::start_merge(size_t first, size_t last) {
+    for (RunCursor *cursor : heap)
+        delete cursor;
+    heap.clear();
+    delete current;
+    current = nullptr;
+    for (size_t i = first; i < last; i++) {
+        runs[i]->rewind();
+        current = new RunCursor{runs[i], (uint) (i - first), std::string(), Row(&input->get_column_names())};
+        if (current->run->next(current->row)) {
+            normalize(current->row, keys, current->key);
+            heap.push_back(current);
+            std::push_heap(heap.begin(), heap.end(), cursor_greater);
+        } else {
+            delete current;
+        }
+        current = nullptr;
+    }
+}
+
+/**
+ * Get the next row of the runs being merged
+ * @param row set to the row (valid until the next call)
+ * @return false if there are no more
+ */
+bool Sort::next_merged(const Row *&row) {
+    if (current != nullptr) {
+        if (current->run->next(current->row)) {
+            normalize(current->row, keys, current->key);
+            heap.push_back(current);
+            std::push_heap(heap.begin(), heap.end(), cursor_greater);
+        } else {
+            delete current;
+        }
+        current = nullptr;
+    }
+    if (heap.empty())
+        return false;
+    std::pop_heap(heap.begin(), heap.end(), cursor_greater);
+    current = heap.back();
+    heap.pop_back();
+    row = &current->row;
+    return true;
+}
+
+/**
+ * Drop the rows, the runs and the merge state
+ */
+void Sort::clear(void) {
+    entries.clear();
+    entry_bytes = 0;
+    position = 0;
+    for (RunCursor *cursor : heap)
+        delete cursor;
+    heap.clear();
+    delete current;
+    current = nullptr;
+    for (SpillFile *run : runs)
+        delete run;
+    runs.clear();
+    returned = 0;
+}
+
+/**
+ * Order of run cursors in the merge heap: the one with the greater key (or, for equal keys, the
+ * later run) sinks, so the top is the next row
+ */
+bool Sort::cursor_greater(const RunCursor *a, const RunCursor *b) {
+    int cmp = a->key.compare(b->key);
+    return cmp > 0 || (cmp == 0 && a->index > b->index);
+}
+
+/**
+ * Read a sort's rows
+ * @param sort the sort
+ * @param ids set to the first column of each row
+ * @param in_order set to whether every row is in order after the one before (by name, then n
+ *                 descending, then id for stability)
+ */
+static void read_sorted(Sort &sort, std::vector<int> &ids, bool &in_order) {
+    ids.clear();
+    in_order = true;
+    std::string last_name;
+    int last_n = 0;
+    RowBatch batch;
+    sort.open();
+    while (sort.next(batch)) {
+        for (uint i = 0; i < batch.size(); i++) {
+            int id = batch[i].get_int(0);
+            std::string name = batch[i].get(1).str();
+            int n = batch[i].get_int(2);
+            if (!ids.empty()) {
+                int cmp = name.compare(last_name);
+                if (cmp < 0 || (cmp == 0 && (n > last_n || (n == last_n && id < ids.back()))))
+                    in_order = false;
+            }
+            ids.push_back(id);
+            last_name = name;
+            last_n = n;
+        }
+    }
+    sort.close();
+}
+
+bool test_sort() {
+    // normalized keys order NULL < values, INT by value, TEXT with a prefix first; DESC reverses
+    ColumnNames key_names;
+    key_names.push_back("n");
+    key_names.push_back("s");
+    Sort::SortKeys by_n{Sort::SortKey{0, false}};
+    Sort::SortKeys by_s_desc{Sort::SortKey{1, true}};
+    Row a(&key_names), b(&key_names);
+    std::string a_key, b_key;
+    bool ok = true;
+    const int ints[] = {INT32_MIN, -1, 0, 1, INT32_MAX};
+    for (uint i = 0; i + 1 < 5; i++) {
+        a.set(0, ints[i]);
+        b.set(0, ints[i + 1]);
+        Sort::normalize(a, by_n, a_key);
+        Sort::normalize(b, by_n, b_key);
+        ok = ok && a_key < b_key;
+    }
+    a.set_null(0, ColumnAttribute::INT);
+    Sort::normalize(a, by_n, a_key);
+    ok = ok && a_key < b_key;
+    const std::string texts[] = {"", "a", std::string("a\0", 2), std::string("a\0b", 3), "ab", "b"};
+    for (uint i = 0; i + 1 < 6; i++) {
+        a.set(1, texts[i]);
+        b.set(1, texts[i + 1]);
+        Sort::normalize(a, by_s_desc, a_key);
+        Sort::normalize(b, by_s_desc, b_key);
+        ok = ok && a_key > b_key;
+    }
+    if (!ok) {
+        std::cout << "normalized sort keys are out of order" << std::endl;
+        return false;
+    }
+
+    ColumnNames column_names;
+    column_names.push_back("id");
+    column_names.push_back("name");
+    column_names.push_back("n");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    HeapTable table("_test_sort_cpp", column_names, column_attributes);
+    table.create();
+    Rows rows(3000, Row(&column_names));
+    for (int i = 0; i < 3000; i++) {
+        rows[i].set(0, i);
+        rows[i].set(1, "name " + std::to_string(i * 7919 % 100));
+        rows[i].set(2, (int) (i * 2654435761u % 20) - 10);
+    }
+    delete table.insert_batch(rows);
+
+    Sort::SortKeys keys{Sort::SortKey{1, false}, Sort::SortKey{2, true}};
+    std::vector<int> expected, ids;
+    bool in_order;
+    Sort in_memory(new TableScan(table), keys);
+    read_sorted(in_memory, expected, in_order);
+    ok = expected.size() == 3000 && in_order && in_memory.get_run_count() == 0;
+
+    // enough runs for more than one merge pass
+    Sort external(new TableScan(table), keys, UINT64_MAX, 4096);
+    read_sorted(external, ids, in_order);
+    ok = ok && ids == expected && in_order && external.get_run_count() > Sort::MAX_FAN_IN;
+
+    // top-N in memory, top-N that outgrows memory, and no rows at all
+    Sort top(new TableScan(table), keys, 25);
+    read_sorted(top, ids, in_order);
+    ok = ok && ids == std::vector<int>(expected.begin(), expected.begin() + 25) && top.get_run_count() == 0;
+    Sort top_external(new TableScan(table), keys, 100, 4096);
+    read_sorted(top_external, ids, in_order);
+    ok = ok && ids == std::vector<int>(expected.begin(), expected.begin() + 100) && top_external.get_run_count() > 0;
+    Sort none(new TableScan(table), keys, 0);
+    read_sorted(none, ids, in_order);
+    ok = ok && ids.empty();
+
+    if (!ok)
+        std::cout << "sort did not return the rows in order" << std::endl;
+    table.drop();
+    return ok;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file sort.h - ORDER BY operator: external merge sort with a top-N fast path.
+ * Sort
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include "eval_plan.h"
+#include "spill_file.h"
+
+/**
+ * @class Sort - the rows of its input ordered by some of their columns
+ *
+ *      Each row's sort columns are first normalized into a byte string whose memcmp order is the
+        sort order (see normalize()), so comparing two rows is one memcmp however the INT and TEXT
+        columns are mixed.
+
+        With a limit (ORDER BY ... LIMIT), only the best limit rows seen so far are kept, in a
+        bounded max-heap; a row that cannot make the cut is dropped after comparing its key with
+        the heap's top, without copying it. If those rows outgrow memory_budget, the sort carries
+        on as an external sort from them.
+
+        Otherwise rows are read until they take memory_budget bytes, sorted and written to a
+        SpillFile as a run (at most limit rows of it), and so on. The runs are merged MAX_FAN_IN
+        at a time with a heap of run cursors until there are few enough to merge while rows are
+        returned. If the input fits in memory nothing is written. The sort is stable.
+ */
+class Sort : public EvalPlan {
+public:
+    struct SortKey {
+        uint col_num;
+        bool descending;
+    };
+    typedef std::vector<SortKey> SortKeys;
+
+    static const uint MAX_FAN_IN = 64;
+    static const size_t DEFAULT_MEMORY = 64 * 1024 * 1024;
+
+    Sort(EvalPlan *input, SortKeys keys, u_int64_t limit = UINT64_MAX, size_t memory_budget = DEFAULT_MEMORY);
+
+    virtual ~Sort();
+
+    virtual void open();
+
+    virtual bool next(RowBatch &batch);
+
+    virtual void close();
+
+    virtual const ColumnNames &get_column_names() const { return input->get_column_names(); }
+
+    virtual const ColumnAttributes &get_column_attributes() const { return input->get_column_attributes(); }
+
+    virtual u_int64_t estimate_blocks() const { return input->estimate_blocks(); }
+
+    virtual uint get_run_count() const { return runs_made; }
+
+    /**
+     * Normalize a row's sort columns into a key that memcmp orders as the rows are to be ordered
+     *      Per column: a byte that is 0 for NULL (so NULL sorts as the smallest value) and 1
+            otherwise, then for INT the value with its sign bit flipped, big-endian, and for TEXT the
+            bytes with each 0 written as 0 0xFF, ended by 0 0. A descending column's bytes are all
+            inverted.
+     * @param row   the row
+     * @param keys  its sort columns
+     * @param key   set to the normalized key
+     */
+    static void normalize(const Row &row, const SortKeys &keys, std::string &key);
+
+protected:
+    struct Entry {
+        std::string key;
+        u_int64_t seq;      // position in the input, to keep the sort stable
+        Row row;
+    };
+
+    /**
+     * @class RunCursor - a run being merged and its current row
+     */
+    struct RunCursor {
+        SpillFile *run;
+        uint index;         // run's position among the runs being merged, for stability
+        std::string key;
+        Row row;
+    };
+
+    EvalPlan *input;
+    SortKeys keys;
+    u_int64_t limit;
+    size_t memory_budget;
+
+    std::vector<Entry> entries;     // sorted rows (or the top-N heap while reading)
+    size_t entry_bytes;
+    size_t position;                // next of entries to return
+    std::vector<SpillFile *> runs;
+    std::vector<RunCursor *> heap;  // cursors of the runs being merged, best on top
+    RunCursor *current;             // cursor of the row next_merged() last gave out
+    u_int64_t returned;
+    uint runs_made;
+
+    virtual void add_top_n(const Row &row, const std::string &key, u_int64_t seq);
+
+    virtual void sort_entries(void);
+
+    virtual void write_run(void);
+
+    virtual void merge_runs(void);
+
+    virtual SpillFile *merge(size_t first, size_t last);
+
+    virtual void start_merge(size_t first, size_t last);
+
+    virtual bool next_merged(const Row *&row);
+
+    virtual void clear(void);
+
+    static bool cursor_greater(const RunCursor *a, const RunCursor *b);
+};
+
+bool test_sort();
@@ -0,0 +1,103 @@
+#include "spill_file.h"
+#include <unistd.h>
+
+/**
+ * @class SpillFile
+ *
+ * Writes rows to a temporary heap file a page at a time and reads them back in order.
+ */
+
+u_int32_t SpillFile::count = 0;
+
+/**
+ * Create an empty temporary file
+ * @param column_attributes the columns of the rows to be written
+ */
+SpillFile::SpillFile(const ColumnAttributes &column_attributes) : column_attributes(column_attributes),
+            codec(column_attributes), bitmap_size((uint) (column_attributes.size() + 7) / 8),
+            file("_spill_" + std::to_string(getpid()) + "_" + std::to_string(++count), false), memory(),
+            data(memory, DbBlock::BLOCK_SZ), page(data, 0, true), blocks(nullptr), block(nullptr), record_id(0),
+            n_rows(0), writing(true) {
+    file.create();
+}
+
+SpillFile::~SpillFile() {
+    delete blocks;
+    file.drop();
+}
+
+/**
+ * Add a row to the end of the file
+ * @param row the row, with a value (or NULL) for every column
+ * @throws DbRelationError if the row is too big for a block, or the file is already being read
+ */
+void SpillFile::append(const Row &row) {
+    if (!writing)
+        throw DbRelationError("cannot append to a spill file after rewind()");
+    size_t size = bitmap_size + (size_t) codec.encoded_size(row);
+    if (size > DbBlock::BLOCK_SZ)
+        throw DbRelationError("Row is too big to fit in a block");
+    RecordID id;
+    char *dest;
+    try {
+        dest = (char *) page.reserve((u_int16_t) size, id);
+    } catch (DbBlockNoRoomError &e) {
+        if (page.get_last_id() == 0)
+            throw DbRelationError("Row is too big to fit in a block");
+        write_page();
+        dest = (char *) page.reserve((u_int16_t) size, id);
+    }
+    std::memset(dest, 0, bitmap_size);
+    for (uint col_num = 0; col_num < column_attributes.size(); col_num++)
+        if (row.is_null(col_num))
+            dest[col_num / 8] |= (char) (1 << (col_num % 8));
+    codec.encode(row, dest + bitmap_size);
+    n_rows++;
+}
+
+/**
+ * Finish writing (the first time) and go back to the first row
+ */
+void SpillFile::rewind(void) {
+    if (writing) {
+        if (page.get_last_id() > 0)
+            write_page();
+        writing = false;
+    }
+    delete blocks;
+    blocks = file.blocks();
+    block = nullptr;
+    record_id = 0;
+}
+
+/**
+ * Read the next row
+ * @param row filled in with the row (its column list must have one name per column)
+ * @return false if there are no more rows
+ */
+bool SpillFile::next(Row &row) {
+    if (blocks == nullptr)
+        return false;
+    while (block == nullptr || record_id >= block->get_last_id()) {
+        if (!blocks->next()) {
+            block = nullptr;
+            return false;
+        }
+        block = blocks->get_block();
+        record_id = 0;
+    }
+    RecordView record = block->view(++record_id);
+    codec.decode(RecordView(record.data + bitmap_size, (u_int16_t) (record.size - bitmap_size)), row);
+    for (uint col_num = 0; col_num < column_attributes.size(); col_num++)
+        if (record.data[col_num / 8] & (1 << (col_num % 8)))
+            row.set_null(col_num, column_attributes[col_num].get_data_type());
+    return true;
+}
+
+/**
+ * Append the packed page to the file and start an empty one
+ */
+void SpillFile::write_page(void) {
+    file.append(memory);
+    page.initialize_new();
+}
@@ -0,0 +1,60 @@
+/**
+ * @file spill_file.h - Temporary file of rows for operators that run out of memory.
+ * SpillFile
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include "heap_storage.h"
+
+/**
+ * @class SpillFile - rows written once, in order, to a temporary HeapFile and then read back
+ *
+ *      Rows are packed into one SlottedPage in memory and each full page is appended to the file
+        with a single write, as the BulkLoader does. rewind() writes the last page and starts
+        reading from the first row; the rows can be read any number of times, but no more can be
+        appended. Each record is a NULL bitmap followed by the row as RowCodec encodes it, so rows
+        with NULLs (e.g. from outer joins) come back as they went in. The file is dropped when the
+        SpillFile is destroyed.
+ */
+class SpillFile {
+public:
+    SpillFile(const ColumnAttributes &column_attributes);
+
+    virtual ~SpillFile();
+
+    SpillFile(const SpillFile &other) = delete;
+
+    SpillFile(SpillFile &&temp) = delete;
+
+    SpillFile &operator=(const SpillFile &other) = delete;
+
+    SpillFile &operator=(SpillFile &&temp) = delete;
+
+    virtual void append(const Row &row);
+
+    virtual void rewind(void);
+
+    virtual bool next(Row &row);
+
+    virtual u_int64_t size(void) const { return n_rows; }
+
+protected:
+    static u_int32_t count;     // files made by this process, to give each a new name
+
+    ColumnAttributes column_attributes;
+    RowCodec codec;
+    uint bitmap_size;
+    HeapFile file;
+    char memory[DbBlock::BLOCK_SZ];
+    Dbt data;
+    SlottedPage page;           // being filled
+    HeapFileIterator *blocks;   // being read
+    SlottedPage *block;
+    RecordID record_id;
+    u_int64_t n_rows;
+    bool writing;
+
+    virtual void write_page(void);
+};
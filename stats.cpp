@@ -0,0 +1,204 @@
+#include "stats.h"
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+/**
+ * @class Stats
+ *
+ * Per-thread operation counters and latency histograms, added up on demand.
+ */
+
+/**
+ * @class ThreadCounters - one thread's counters (atomic only so snapshot() can read them while the thread runs)
+ */
+struct ThreadCounters {
+    struct Op {
+        std::atomic<u_int64_t> count;
+        std::atomic<u_int64_t> total_ns;
+        std::atomic<u_int64_t> buckets[Stats::BUCKETS];
+    };
+    Op ops[Stats::N_OPS];
+};
+
+static std::mutex &registry_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+// the counters of every running thread that has recorded something
+static std::vector<ThreadCounters *> &registry() {
+    static std::vector<ThreadCounters *> threads;
+    return threads;
+}
+
+// the totals of the threads that have exited, and the totals as of the last reset()
+static std::vector<Stats::Counters> &retired() {
+    static std::vector<Stats::Counters> totals(Stats::N_OPS, Stats::Counters());
+    return totals;
+}
+
+static std::vector<Stats::Counters> &baseline() {
+    static std::vector<Stats::Counters> totals(Stats::N_OPS, Stats::Counters());
+    return totals;
+}
+
+/**
+ * @class ThreadCountersHolder - registers a thread's counters on its first record(), and retires them when it exits
+ */
+class ThreadCountersHolder {
+public:
+    ThreadCounters *counters;
+
+    ThreadCountersHolder() : counters(new ThreadCounters()) {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        registry().push_back(counters);
+    }
+
+    ~ThreadCountersHolder() {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        add(retired(), counters);
+        for (size_t i = 0; i < registry().size(); i++) {
+            if (registry()[i] == counters) {
+                registry().erase(registry().begin() + i);
+                break;
+            }
+        }
+        delete counters;
+    }
+
+    ThreadCountersHolder(const ThreadCountersHolder &other) = delete;
+
+    ThreadCountersHolder &operator=(const ThreadCountersHolder &other) = delete;
+
+    static void add(std::vector<Stats::Counters> &totals, const ThreadCounters *counters) {
+        for (uint op = 0; op < Stats::N_OPS; op++) {
+            totals[op].count += counters->ops[op].count.load(std::memory_order_relaxed);
+            totals[op].total_ns += counters->ops[op].total_ns.load(std::memory_order_relaxed);
+            for (uint b = 0; b < Stats::BUCKETS; b++)
+                totals[op].buckets[b] += counters->ops[op].buckets[b].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+static thread_local ThreadCountersHolder holder;
+
+// only the owning thread writes its counters, so an add needs no locked instruction
+static inline void bump(std::atomic<u_int64_t> &counter, u_int64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+ * Count one run of an operation
+ * @param op the operation
+ * @param ns how long it took, in nanoseconds
+ */
+void Stats::record(Op op, u_int64_t ns) {
+    ThreadCounters::Op &counters = holder.counters->ops[op];
+    uint bucket = ns == 0 ? 0 : 63 - (uint) __builtin_clzll(ns);
+    if (bucket >= BUCKETS)
+        bucket = BUCKETS - 1;
+    bump(counters.count, 1);
+    bump(counters.total_ns, ns);
+    bump(counters.buckets[bucket], 1);
+}
+
+/**
+ * Add up the counters of every thread
+ * @return each operation's totals since the last reset(), indexed by Op
+ */
+std::vector<Stats::Counters> Stats::snapshot() {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    std::vector<Counters> totals = retired();
+    for (const ThreadCounters *counters : registry())
+        ThreadCountersHolder::add(totals, counters);
+    for (uint op = 0; op < N_OPS; op++) {
+        totals[op].count -= baseline()[op].count;
+        totals[op].total_ns -= baseline()[op].total_ns;
+        for (uint b = 0; b < BUCKETS; b++)
+            totals[op].buckets[b] -= baseline()[op].buckets[b];
+    }
+    return totals;
+}
+
+/**
+ * Start counting from zero again
+ */
+void Stats::reset() {
+    std::vector<Counters> totals = snapshot();
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    for (uint op = 0; op < N_OPS; op++) {
+        baseline()[op].count += totals[op].count;
+        baseline()[op].total_ns += totals[op].total_ns;
+        for (uint b = 0; b < BUCKETS; b++)
+            baseline()[op].buckets[b] += totals[op].buckets[b];
+    }
+}
+
+u_int64_t Stats::percentile(const Counters &counters, double fraction) {
+    if (counters.count == 0)
+        return 0;
+    u_int64_t rank = (u_int64_t) (fraction * counters.count);
+    if (rank == 0)
+        rank = 1;
+    u_int64_t seen = 0;
+    for (uint b = 0; b < BUCKETS; b++) {
+        seen += counters.buckets[b];
+        if (seen >= rank)
+            return (u_int64_t) 1 << (b + 1);
+    }
+    return (u_int64_t) 1 << BUCKETS;
+}
+
+const char *Stats::op_name(Op op) {
+    static const char *names[N_OPS] = {"HeapFile::get", "HeapFile::put", "HeapFile::get_new", "SlottedPage::add",
+                                       "SlottedPage::put", "SlottedPage::del", "SlottedPage::compact",
+                                       "HeapTable::insert", "HeapTable::select", "HeapTable::project"};
+    return names[op];
+}
+
+/**
+ * Format a snapshot for SHOW STATS
+ * @return a line per operation: how many times it ran, and its mean, median and 99th percentile
+ *         latency (the percentiles are upper bounds of histogram buckets)
+ */
+std::string Stats::report() {
+    std::vector<Counters> totals = snapshot();
+    std::stringstream out;
+    out << std::left << std::setw(22) << "operation" << std::right << std::setw(12) << "count"
+        << std::setw(12) << "mean us" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::endl;
+    out << std::fixed << std::setprecision(2);
+    for (uint op = 0; op < N_OPS; op++) {
+        const Counters &counters = totals[op];
+        out << std::left << std::setw(22) << op_name((Op) op) << std::right << std::setw(12) << counters.count
+            << std::setw(12) << (counters.count == 0 ? 0.0 : counters.total_ns / 1000.0 / counters.count)
+            << std::setw(12) << percentile(counters, 0.5) / 1000.0
+            << std::setw(12) << percentile(counters, 0.99) / 1000.0 << std::endl;
+    }
+#if !DB_STATS
+    out << "(built with DB_STATS=0, so nothing is counted)" << std::endl;
+#endif
+    return out.str();
+}
+
+bool test_stats() {
+    Stats::reset();
+    std::thread worker([]() {
+        for (int i = 0; i < 1000; i++)
+            Stats::record(Stats::FILE_GET, 100);
+    });
+    worker.join();  // its counters are retired, and still counted
+    for (int i = 0; i < 10; i++)
+        Stats::record(Stats::FILE_GET, 5000);
+    std::vector<Stats::Counters> totals = Stats::snapshot();
+    const Stats::Counters &get = totals[Stats::FILE_GET];
+    bool ok = get.count == 1010 && get.total_ns == 1000 * 100 + 10 * 5000 && get.buckets[6] == 1000
+              && get.buckets[12] == 10 && Stats::percentile(get, 0.5) == 128 && Stats::percentile(get, 1.0) == 8192;
+    Stats::reset();
+    ok = ok && Stats::snapshot()[Stats::FILE_GET].count == 0;
+    if (!ok)
+        std::cout << "stats did not add up the counters" << std::endl;
+    return ok;
+}
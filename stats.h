@@ -0,0 +1,105 @@
+/**
+ * @file stats.h - Operation counters and latency histograms for the storage engine's hot paths, and trace output.
+ * Stats
+ * StatsTimer
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// compile with -DTRACE_LEVEL=1 to log HeapFile creates, opens, closes and drops (0 leaves them out)
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL 0
+#endif
+
+#define TRACE(level, message) \
+    do { if (TRACE_LEVEL >= (level)) std::cout << message << std::endl; } while (0)
+
+// compile with -DDB_STATS=0 to leave the counters and timers out altogether
+#ifndef DB_STATS
+#define DB_STATS 1
+#endif
+
+/**
+ * @class Stats - how many times each hot-path operation has run, and how long it took
+ *
+ *      Each thread counts into its own counters (a plain load and store each, since only that
+        thread writes them), so the operations never contend. A latency lands in bucket b of its
+        operation's histogram when it is in [2^b, 2^(b+1)) nanoseconds. snapshot() adds up every
+        thread's counters, and those of threads that have exited, when it is asked for them;
+        reset() just remembers the current totals so later snapshots start from zero.
+ */
+class Stats {
+public:
+    // FILE_GET is any block read (HeapFile::get or read), FILE_GET_NEW any block added (allocate or
+    // append) and PAGE_ADD any record added (SlottedPage::add or reserve)
+    enum Op {
+        FILE_GET, FILE_PUT, FILE_GET_NEW, PAGE_ADD, PAGE_PUT, PAGE_DEL, PAGE_COMPACT, TABLE_INSERT, TABLE_SELECT,
+        TABLE_PROJECT, N_OPS
+    };
+
+    static const uint BUCKETS = 32;     // the last one also gets everything slower
+
+    struct Counters {
+        u_int64_t count;
+        u_int64_t total_ns;
+        u_int64_t buckets[BUCKETS];
+    };
+
+    static void record(Op op, u_int64_t ns);
+
+    static std::vector<Counters> snapshot(void);
+
+    static void reset(void);
+
+    static std::string report(void);
+
+    static const char *op_name(Op op);
+
+    /**
+     * Estimate a percentile of an operation's latency from its histogram
+     * @param counters  the operation's counters
+     * @param fraction  which percentile (e.g. 0.99)
+     * @return the upper bound of the bucket it falls in, in nanoseconds (0 if there are no counts)
+     */
+    static u_int64_t percentile(const Counters &counters, double fraction);
+};
+
+/**
+ * @class StatsTimer - times the scope it is declared in, as one run of an operation
+ */
+class StatsTimer {
+public:
+    explicit StatsTimer(Stats::Op op) : op(op), start(std::chrono::steady_clock::now()) {}
+
+    ~StatsTimer() {
+        Stats::record(op, (u_int64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+
+    StatsTimer(const StatsTimer &other) = delete;
+
+    StatsTimer(StatsTimer &&temp) = delete;
+
+    StatsTimer &operator=(const StatsTimer &other) = delete;
+
+    StatsTimer &operator=(StatsTimer &&temp) = delete;
+
+protected:
+    Stats::Op op;
+    std::chrono::steady_clock::time_point start;
+};
+
+#if DB_STATS
+#define STATS_TIMER(op) StatsTimer stats_timer(Stats::op)
+#else
+#define STATS_TIMER(op) do {} while (0)
+#endif
+
+bool test_stats();
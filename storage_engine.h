@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <exception>
 #include <map>
 #include <utility>
@@ -28,6 +30,27 @@ typedef u_int32_t BlockID;
 typedef std::vector<RecordID> RecordIDs;
 typedef std::length_error DbBlockNoRoomError;
 
+/**
+ * @class RecordView - non-owning view of one record's bytes inside a block
+ *
+ * Returned by value, so reading a record allocates nothing. It is only valid as long as the block
+ * it came from stays in memory (e.g. while the block is pinned in a buffer pool).
+ */
+class RecordView {
+public:
+    const char *data;
+    u_int16_t size;
+
+    RecordView() : data(nullptr), size(0) {}
+
+    RecordView(const void *data, u_int16_t size) : data((const char *) data), size(size) {}
+
+    /**
+     * @returns  true if there is no such record (e.g. it was deleted)
+     */
+    bool is_null() const { return data == nullptr; }
+};
+
 /**
  * @class DbBlock - abstract base class for blocks in our database files 
  * (DbBlock's belong to DbFile's.)
@@ -36,6 +59,7 @@ typedef std::length_error DbBlockNoRoomError;
  * 	initialize_new()
  * 	add(data)
  * 	get(record_id)
+ * 	view(record_id)
  * 	put(record_id, data)
  * 	del(record_id)
  * 	ids()
@@ -78,6 +102,14 @@ public:
      */
     virtual Dbt *get(RecordID record_id) = 0;
 
+    /**
+     * Get a record from this block without copying it.
+     * @param record_id  which record to fetch
+     * @returns          view of the data stored for the given record (null if there is none),
+     *                   only valid while this block's memory is
+     */
+    virtual RecordView view(RecordID record_id) = 0;
+
     /**
      * Change the data stored for a record in this block.
      * @param record_id  which record to update
@@ -123,7 +155,39 @@ protected:
 };
 
 // convenience type alias
-typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an iterator at some point
+typedef std::vector<BlockID> BlockIDs;
+
+/**
+ * @class DbBlockIterator - abstract base class for a forward iterator over the blocks of a DbFile
+ *
+ * Usage:
+ *      DbBlockIterator *blocks = file.blocks();
+ *      while (blocks->next())
+ *          do_something(blocks->get_block());
+ *      delete blocks;
+ */
+class DbBlockIterator {
+public:
+    virtual ~DbBlockIterator() {}
+
+    /**
+     * Advance to the next block in the file.
+     * @returns  false once there are no more blocks
+     */
+    virtual bool next() = 0;
+
+    /**
+     * Get the BlockID of the current block.
+     * @returns  the current block's id
+     */
+    virtual BlockID get_block_id() = 0;
+
+    /**
+     * Get the current block.
+     * @returns  the current block (owned by the iterator, only valid until the next call to next())
+     */
+    virtual DbBlock *get_block() = 0;
+};
 
 /**
  * @class DbFile - abstract base class which represents a disk-based collection of DbBlocks
@@ -135,6 +199,7 @@ typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an
  *	get(block_id)
  *	put(block)
  *	block_ids()
+ *	blocks()
  */
 class DbFile {
 public:
@@ -184,11 +249,17 @@ public:
 
     /**
      * Get a list of all the valid BlockID's in the file
-     * FIXME - not a good long-term approach, but we'll do this until we put in iterators
+     * Prefer blocks() for scans, since this materializes every id up front.
      * @returns  a pointer to vector of BlockIDs (freed by caller)
      */
     virtual BlockIDs *block_ids() = 0;
 
+    /**
+     * Iterate through all the blocks in the file, in BlockID order.
+     * @returns  a pointer to a block iterator (freed by caller)
+     */
+    virtual DbBlockIterator *blocks() = 0;
+
 protected:
     std::string name;  // filename (or part of it)
 };
@@ -207,7 +278,7 @@ public:
 
     virtual ~ColumnAttribute() {}
 
-    virtual DataType get_data_type() { return data_type; }
+    virtual DataType get_data_type() const { return data_type; }
 
     virtual void set_data_type(DataType data_type) { this->data_type = data_type; }
 
@@ -232,6 +303,46 @@ public:
     Value(std::string s) : n(0), s(s) { data_type = ColumnAttribute::TEXT; }
 };
 
+/**
+ * @class ValueView - non-owning counterpart of Value
+ *
+ * A TEXT value points at its bytes inside the block it was read from, so it is only valid while that
+ * block is. Use value() to get an owning copy.
+ */
+class ValueView {
+public:
+    ColumnAttribute::DataType data_type;
+    int32_t n;
+    const char *s;
+    u_int32_t s_size;
+
+    ValueView() : data_type(ColumnAttribute::INT), n(0), s(nullptr), s_size(0) {}
+
+    explicit ValueView(const Value &value) : data_type(value.data_type), n(value.n), s(value.s.data()),
+                                             s_size((u_int32_t) value.s.size()) {}
+
+    std::string str() const { return std::string(s, s_size); }
+
+    Value value() const { return data_type == ColumnAttribute::INT ? Value(n) : Value(str()); }
+
+    /**
+     * Compare with a value of the same type (TEXT byte by byte, a prefix first)
+     * @param other  the value to compare with
+     * @returns      negative, zero or positive as this value is less than, equal to or greater than other
+     */
+    int compare(const ValueView &other) const {
+        if (data_type == ColumnAttribute::INT)
+            return n < other.n ? -1 : n > other.n;
+        size_t size = std::min(s_size, other.s_size);
+        int cmp = size == 0 ? 0 : memcmp(s, other.s, size);
+        if (cmp == 0)
+            cmp = s_size < other.s_size ? -1 : s_size > other.s_size;
+        return cmp;
+    }
+};
+
+typedef std::vector<ValueView> ValueViews;  // one per column, in column order
+
 // More type aliases
 typedef std::string Identifier;
 typedef std::vector<Identifier> ColumnNames;
@@ -241,6 +352,274 @@ typedef std::vector<Handle> Handles;  // FIXME: will need to turn this into an i
 typedef std::map<Identifier, Value> ValueDict;
 
 
+/**
+ * @class Row - the values of one row, by column ordinal
+ *
+ * Compact alternative to ValueDict. Names are not stored with each row: the row points at a
+ * ColumnNames list (usually the relation's own) that names each ordinal, and that list must outlive
+ * the row. Every value is a fixed-size tagged slot and all TEXT bytes share one buffer, so a row
+ * costs two allocations at most, and none when a Row is reused (clear() keeps its capacity).
+ * A value can be NULL (e.g. the missing side of an outer join); tables never store NULLs.
+ *
+ * Usage:
+ *      Row row(&relation.get_column_names());
+ *      row.set(0, 12);
+ *      row.set(1, "Hello!");
+ *      relation.insert(row);
+ */
+class Row {
+public:
+    Row() : column_names(nullptr), slots(), text() {}
+
+    explicit Row(const ColumnNames *column_names) : column_names(column_names), slots(column_names->size()), text() {}
+
+    const ColumnNames *get_column_names() const { return column_names; }
+
+    /**
+     * Switch to another list of columns, clearing all the values.
+     * @param column_names  names of the columns, in order (not owned)
+     */
+    void set_column_names(const ColumnNames *column_names) {
+        this->column_names = column_names;
+        clear();
+    }
+
+    uint size() const { return (uint) slots.size(); }
+
+    /**
+     * Reset every column to INT 0, keeping the memory already allocated.
+     */
+    void clear() {
+        slots.assign(column_names == nullptr ? 0 : column_names->size(), Slot());
+        text.clear();
+    }
+
+    ColumnAttribute::DataType get_data_type(uint col_num) const { return slots[col_num].data_type; }
+
+    bool is_null(uint col_num) const { return slots[col_num].null; }
+
+    int32_t get_int(uint col_num) const { return slots[col_num].n; }
+
+    /**
+     * Get a column's value without copying it.
+     * @param col_num  which column
+     * @returns        the value (TEXT points into this row, so only valid until the row is next changed)
+     */
+    ValueView get(uint col_num) const {
+        const Slot &slot = slots[col_num];
+        ValueView value;
+        value.data_type = slot.data_type;
+        value.n = slot.n;
+        if (slot.data_type == ColumnAttribute::TEXT) {
+            value.s = text.data() + slot.offset;
+            value.s_size = slot.size;
+        }
+        return value;
+    }
+
+    Value get_value(uint col_num) const { return get(col_num).value(); }
+
+    void set(uint col_num, int32_t n) {
+        Slot &slot = slots[col_num];
+        slot.data_type = ColumnAttribute::INT;
+        slot.null = false;
+        slot.n = n;
+    }
+
+    void set(uint col_num, const char *s, size_t size) {
+        Slot &slot = slots[col_num];
+        slot.data_type = ColumnAttribute::TEXT;
+        slot.null = false;
+        slot.offset = (u_int32_t) text.size();
+        slot.size = (u_int32_t) size;
+        text.append(s, size);
+    }
+
+    void set(uint col_num, const std::string &s) { set(col_num, s.data(), s.size()); }
+
+    void set(uint col_num, const ValueView &value) {
+        if (value.data_type == ColumnAttribute::INT)
+            set(col_num, value.n);
+        else
+            set(col_num, value.s, value.s_size);
+    }
+
+    void set(uint col_num, const Value &value) {
+        if (value.data_type == ColumnAttribute::INT)
+            set(col_num, value.n);
+        else
+            set(col_num, value.s);
+    }
+
+    /**
+     * Copy a value, NULL or not, from another row.
+     * @param col_num       the column to set
+     * @param from          the row to copy from
+     * @param from_col_num  the column to copy
+     */
+    void set(uint col_num, const Row &from, uint from_col_num) {
+        if (from.is_null(from_col_num))
+            set_null(col_num, from.get_data_type(from_col_num));
+        else
+            set(col_num, from.get(from_col_num));
+    }
+
+    /**
+     * Make a value NULL. It reads as 0 or "" to code that does not check is_null().
+     * @param col_num    the column
+     * @param data_type  the column's type
+     */
+    void set_null(uint col_num, ColumnAttribute::DataType data_type) {
+        if (data_type == ColumnAttribute::INT)
+            set(col_num, 0);
+        else
+            set(col_num, "", 0);
+        slots[col_num].null = true;
+    }
+
+    /**
+     * Look up a column's ordinal by name.
+     * @param column_name  name of the column
+     * @returns            its ordinal in this row, or -1 if the row has no such column
+     */
+    int find(const Identifier &column_name) const {
+        for (uint col_num = 0; col_num < slots.size(); col_num++)
+            if ((*column_names)[col_num] == column_name)
+                return (int) col_num;
+        return -1;
+    }
+
+    /**
+     * Copy this row into a dictionary keyed by column name.
+     * @returns  the row's values (freed by caller)
+     */
+    ValueDict *to_dict() const {
+        ValueDict *dict = new ValueDict();
+        for (uint col_num = 0; col_num < slots.size(); col_num++)
+            (*dict)[(*column_names)[col_num]] = get_value(col_num);
+        return dict;
+    }
+
+protected:
+    struct Slot {
+        ColumnAttribute::DataType data_type;
+        bool null;
+        int32_t n;          // INT value
+        u_int32_t offset;   // TEXT value's bytes in text
+        u_int32_t size;
+
+        Slot() : data_type(ColumnAttribute::INT), null(false), n(0), offset(0), size(0) {}
+    };
+
+    const ColumnNames *column_names;
+    std::vector<Slot> slots;
+    std::string text;  // bytes of every TEXT value (a value that is set again leaves its old bytes until clear())
+};
+
+typedef std::vector<Row> Rows;
+
+
+/**
+ * @class Predicate - compares one column to a constant
+ *
+ * A where clause is a list of them (Predicates) that must all hold.
+ */
+class Predicate {
+public:
+    enum Op {
+        EQ, NE, LT, LE, GT, GE
+    };
+
+    Identifier column_name;
+    Op op;
+    Value value;
+
+    Predicate(Identifier column_name, Op op, Value value) : column_name(column_name), op(op), value(value) {}
+
+    /**
+     * Check a value of this predicate's column (of the same type as the predicate's value).
+     * @param column_value  the value to check
+     * @returns             true if it satisfies the predicate
+     */
+    bool matches(const ValueView &column_value) const {
+        return holds(op, column_value.compare(ValueView(value)));
+    }
+
+    /**
+     * Check the outcome of a comparison against an operator.
+     * @param op   the operator
+     * @param cmp  negative, zero or positive as the left side is less than, equal to or greater than the right
+     * @returns    true if "left op right" holds
+     */
+    static bool holds(Op op, int cmp) {
+        switch (op) {
+            case EQ:
+                return cmp == 0;
+            case NE:
+                return cmp != 0;
+            case LT:
+                return cmp < 0;
+            case LE:
+                return cmp <= 0;
+            case GT:
+                return cmp > 0;
+            default:
+                return cmp >= 0;
+        }
+    }
+};
+
+typedef std::vector<Predicate> Predicates;  // all must hold
+
+
+/**
+ * @class DbRelationIterator - abstract base class for a forward iterator over the rows of a DbRelation
+ *
+ * Rows are produced a block at a time, so memory use does not depend on the size of the relation
+ * and the caller can stop as soon as it has what it needs (LIMIT, EXISTS, first match).
+ *
+ * Usage:
+ *      DbRelationIterator *rows = relation.scan();
+ *      while (rows->next())
+ *          do_something(rows->get_handle());
+ *      delete rows;
+ */
+class DbRelationIterator {
+public:
+    virtual ~DbRelationIterator() {}
+
+    /**
+     * Advance to the next row.
+     * @returns  false once there are no more rows
+     */
+    virtual bool next() = 0;
+
+    /**
+     * Get the handle of the current row.
+     * @returns  handle to the current row
+     */
+    virtual Handle get_handle() = 0;
+
+    /**
+     * Get all the values of the current row (SELECT *) without fetching its block again.
+     * @returns  dictionary of values from the current row (freed by caller)
+     */
+    virtual ValueDict *get_row() = 0;
+
+    /**
+     * Get all the values of the current row into a reusable Row.
+     * @param row  set to the relation's columns and filled in (its memory is reused from row to row)
+     */
+    virtual void get_row(Row &row) = 0;
+
+    /**
+     * Get all the values of the current row without copying them out of its block.
+     * @returns  values in column order, only valid until the next call to next()
+     */
+    virtual const ValueViews &get_row_view() = 0;
+};
+
+
 /**
  * @class DbRelationError - generic exception class for DbRelation
  */
@@ -262,12 +641,24 @@ public:
  * 	close()
  * 	
  *	insert(row)
+ *	insert_batch(rows)
  *	update(handle, new_values)
  *	del(handle)
  *	select()
  *	select(where)
+ *	select(predicates)
+ *	parallel_select(predicates, n_threads, ordered)
+ *	scan()
  *	project(handle)
  *	project(handle, column_names)
+ *	project(handle, row)
+ * Accessors:
+ * 	get_table_name()
+ * 	get_column_names()
+ * 	get_column_attributes()
+ *
+ * The Row overloads of insert, update and project take values by column ordinal; the ValueDict
+ * ones are conveniences for callers that only have names.
  */
 class DbRelation {
 public:
@@ -313,6 +704,21 @@ public:
      */
     virtual Handle insert(const ValueDict *row) = 0;
 
+    /**
+     * Execute: INSERT INTO <table_name> VALUES ( <row_values> )
+     * @param row  the values, normally in this relation's column order (get_column_names()); a row with
+     *             its own column list is matched to this relation's columns by name
+     * @returns    a handle to the new row
+     */
+    virtual Handle insert(const Row &row) = 0;
+
+    /**
+     * Insert many rows at once. Every row is validated before any is inserted.
+     * @param rows  the rows to insert (see insert(Row))
+     * @returns     handles to the new rows, in the same order (freed by caller)
+     */
+    virtual Handles *insert_batch(const Rows &rows) = 0;
+
     /**
      * Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
      * where handle is sufficient to identify one specific record (e.g., returned
@@ -322,6 +728,13 @@ public:
      */
     virtual void update(const Handle handle, const ValueDict *new_values) = 0;
 
+    /**
+     * Same as update(handle, ValueDict), with the changing columns named by new_values' column list.
+     * @param handle      the row to update
+     * @param new_values  values for the changing columns
+     */
+    virtual void update(const Handle handle, const Row &new_values) = 0;
+
     /**
      * Conceptually, execute: DELETE FROM <table_name> WHERE <handle>
      * where handle is sufficient to identify one specific record (e.g, returned
@@ -343,6 +756,30 @@ public:
      */
     virtual Handles *select(const ValueDict *where) = 0;
 
+    /**
+     * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
+     * with comparisons other than equality
+     * @param where  predicates that must all hold
+     * @returns      a pointer to a list of handles for qualifying rows (freed by caller)
+     */
+    virtual Handles *select(const Predicates &where) = 0;
+
+    /**
+     * select(where) with the scan split across threads. The table may fall back to a serial
+     * select, e.g. when an index answers the query or the table is small.
+     * @param where      predicates that must all hold
+     * @param n_threads  degree of parallelism for this query
+     * @param ordered    whether the handles must come back in the order select(where) gives them
+     * @returns          a pointer to a list of handles for qualifying rows (freed by caller)
+     */
+    virtual Handles *parallel_select(const Predicates &where, uint n_threads, bool ordered = true) = 0;
+
+    /**
+     * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE 1, one row at a time
+     * @returns  a pointer to an iterator over all the rows (freed by caller)
+     */
+    virtual DbRelationIterator *scan() = 0;
+
     /**
      * Return a sequence of all values for handle (SELECT *).
      * @param handle  row to get values from
@@ -359,9 +796,152 @@ public:
      */
     virtual ValueDict *project(Handle handle, const ColumnNames *column_names) = 0;
 
+    /**
+     * Fill in the values for handle of the columns in row's column list
+     * (SELECT <row's column names>, or SELECT * if the list is get_column_names()).
+     * @param handle  row to get values from
+     * @param row     filled in with the row's values (its memory is reused)
+     */
+    virtual void project(Handle handle, Row &row) = 0;
+
+    virtual const Identifier &get_table_name() const { return table_name; }
+
+    virtual const ColumnNames &get_column_names() const { return column_names; }
+
+    virtual const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+
 protected:
     Identifier table_name;
     ColumnNames column_names;
     ColumnAttributes column_attributes;
 };
 
+
+/**
+ * @class DbIndex - abstract base class for an index on a DbRelation
+ *
+ * Maps the values of the key columns of each row to the row's handle.
+ *
+ * Methods:
+ * 	create()
+ * 	drop()
+ * 	open()
+ * 	close()
+ * 	lookup(key_values)
+ * 	range(min_key, max_key)
+ * 	insert(handle, row)
+ * 	del(handle, row)
+ * 	update(handle, old_row, new_row)
+ * Accessors:
+ * 	get_name()
+ * 	get_key_columns()
+ * 	is_unique()
+ * 	supports_range()
+ */
+class DbIndex {
+public:
+    DbIndex(DbRelation &relation, Identifier name, ColumnNames key_columns, bool unique)
+            : relation(relation), name(name), key_columns(key_columns), unique(unique) {}
+
+    virtual ~DbIndex() {}
+
+    /**
+     * Create the index and fill it from the relation's current rows.
+     */
+    virtual void create() = 0;
+
+    /**
+     * Remove the index.
+     */
+    virtual void drop() = 0;
+
+    /**
+     * Open an existing index.
+     */
+    virtual void open() = 0;
+
+    /**
+     * Close the index.
+     */
+    virtual void close() = 0;
+
+    /**
+     * Find the rows with the given key.
+     * @param key_values  dictionary of the key columns' values
+     * @returns           handles of the matching rows (freed by caller); an index that stores only
+     *                    hashes of keys may include a few rows whose keys just hash the same
+     */
+    virtual Handles *lookup(const ValueDict *key_values) = 0;
+
+    /**
+     * Find the rows with keys between min_key and max_key, inclusive, in key order.
+     * @param min_key  lowest key, or nullptr for no lower bound
+     * @param max_key  highest key, or nullptr for no upper bound
+     * @returns        handles of the matching rows (freed by caller)
+     * @throws         DbRelationError if this kind of index is not ordered (see supports_range())
+     */
+    virtual Handles *range(const ValueDict *min_key, const ValueDict *max_key) {
+        throw DbRelationError("range queries not supported by this index");
+    }
+
+    /**
+     * Add a row to the index.
+     * @param handle  the row's handle
+     * @param row     the row's values, in the relation's column order
+     */
+    virtual void insert(Handle handle, const Row &row) = 0;
+
+    /**
+     * Remove a row from the index.
+     * @param handle  the row's handle
+     * @param row     the row's values when it was indexed, in the relation's column order
+     */
+    virtual void del(Handle handle, const Row &row) = 0;
+
+    /**
+     * Add a row to the index, reading its values from the relation.
+     * @param handle  the row's handle
+     */
+    virtual void insert(Handle handle) {
+        Row row(&relation.get_column_names());
+        relation.project(handle, row);
+        insert(handle, row);
+    }
+
+    /**
+     * Remove a row from the index, reading its values from the relation.
+     * @param handle  the row's handle
+     */
+    virtual void del(Handle handle) {
+        Row row(&relation.get_column_names());
+        relation.project(handle, row);
+        del(handle, row);
+    }
+
+    /**
+     * Re-index a row whose values changed.
+     * @param handle   the row's handle
+     * @param old_row  the row's values when it was indexed
+     * @param new_row  the row's values now
+     */
+    virtual void update(Handle handle, const Row &old_row, const Row &new_row) {
+        del(handle, old_row);
+        insert(handle, new_row);
+    }
+
+    virtual const Identifier &get_name() const { return name; }
+
+    virtual const ColumnNames &get_key_columns() const { return key_columns; }
+
+    virtual bool is_unique() const { return unique; }
+
+    virtual bool supports_range() const { return false; }
+
+protected:
+    DbRelation &relation;
+    Identifier name;
+    ColumnNames key_columns;
+    bool unique;
+};
+
+typedef std::vector<DbIndex *> DbIndices;
@@ -0,0 +1,98 @@
+#include "thread_pool.h"
+
+/**
+ * @class ThreadPool
+ *
+ * Runs tasks on a fixed set of worker threads.
+ */
+
+/**
+ * Start the workers
+ * @param n_threads number of worker threads (at least one is started)
+ */
+ThreadPool::ThreadPool(uint n_threads) : workers(), tasks(), mutex(), task_ready(), all_done(), outstanding(0),
+            error(), stopping(false) {
+    if (n_threads == 0)
+        n_threads = 1;
+    for (uint i = 0; i < n_threads; i++)
+        workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+/**
+ * Finish the queued tasks and join the workers
+ */
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_ready.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+/**
+ * Queue a task for the next free worker
+ * @param task the work to do
+ */
+void ThreadPool::submit(Task task) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        tasks.push_back(task);
+        outstanding++;
+    }
+    task_ready.notify_one();
+}
+
+/**
+ * Block until every submitted task has finished
+ * @throws the first exception thrown by any of the tasks
+ */
+void ThreadPool::wait(void) {
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this] { return outstanding == 0; });
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+/**
+ * Number of threads to use when the caller has no better idea: one per hardware thread
+ * @return at least 1
+ */
+uint ThreadPool::default_threads(void) {
+    uint n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+/**
+ * Worker loop: run tasks until the pool is stopping and the queue is empty
+ */
+void ThreadPool::work(void) {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            task_ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = tasks.front();
+            tasks.pop_front();
+        }
+
+        std::exception_ptr e;
+        try {
+            task();
+        } catch (...) {
+            e = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (e && !error)
+            error = e;
+        if (--outstanding == 0)
+            all_done.notify_all();
+    }
+}
@@ -0,0 +1,60 @@
+/**
+ * @file thread_pool.h - Fixed set of worker threads running submitted tasks.
+ * ThreadPool
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool - n worker threads taking tasks from a shared queue
+ *
+ *      Tasks are run in the order they are submitted, by whichever worker is free. wait() blocks
+        until every task submitted so far has finished; if any of them threw, it rethrows the first
+        exception (the rest are dropped). The workers are joined when the pool is destroyed.
+ */
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    ThreadPool(uint n_threads = default_threads());
+
+    virtual ~ThreadPool();
+
+    ThreadPool(const ThreadPool &other) = delete;
+
+    ThreadPool(ThreadPool &&temp) = delete;
+
+    ThreadPool &operator=(const ThreadPool &other) = delete;
+
+    ThreadPool &operator=(ThreadPool &&temp) = delete;
+
+    virtual void submit(Task task);
+
+    virtual void wait(void);
+
+    virtual uint size(void) const { return (uint) workers.size(); }
+
+    static uint default_threads(void);
+
+protected:
+    std::vector<std::thread> workers;
+    std::deque<Task> tasks;
+    std::mutex mutex;
+    std::condition_variable task_ready;     // signalled when a task is queued or the pool stops
+    std::condition_variable all_done;       // signalled when the last outstanding task finishes
+    uint outstanding;                       // tasks queued or running
+    std::exception_ptr error;               // first exception thrown by a task since the last wait()
+    bool stopping;
+
+    virtual void work(void);
+};
@@ -0,0 +1,575 @@
+#include "wal.h"
+#include "heap_storage.h"
+#include "buffer_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+/**
+ * @class WriteAheadLog
+ *
+ * Logs whole blocks, writes them out in groups shared by concurrent commits, and replays them on open.
+ */
+
+WriteAheadLog *_DB_LOG = nullptr;
+
+/*
+ * Each record is a header, the file's name and, for a PAGE, the block's image:
+ *      Bytes 0x00 - 0x03: MAGIC
+ *      Byte  0x04:        record type
+ *      Bytes 0x05 - 0x06: length of the file's name
+ *      Bytes 0x07 - 0x0a: block id (0 for CREATE and DROP)
+ *      Bytes 0x0b - 0x0e: checksum of the rest of the record
+ * A torn or corrupt record ends the log when it is replayed.
+ */
+static const u_int32_t MAGIC = 0x57414c31;  // "WAL1"
+static const size_t HEADER_SZ = 15;
+static const size_t CHECKSUM_OFFSET = 11;
+
+// the last group each thread logged to, and which log it was (so commit() finds what to wait for)
+struct LastRecord {
+    u_int64_t log_id;
+    u_int64_t group;
+};
+static thread_local LastRecord last_record = {0, 0};
+
+static std::atomic<u_int64_t> next_log_id(1);
+
+static u_int32_t fnv1a(const char *data, size_t size, u_int32_t hash = 2166136261u) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (u_int8_t) data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// checksum of a record: its header (but the checksum itself), name and image
+static u_int32_t checksum(const char *record, size_t size) {
+    return fnv1a(record + HEADER_SZ, size - HEADER_SZ, fnv1a(record, CHECKSUM_OFFSET));
+}
+
+WriteAheadLog::WriteAheadLog(const std::string &path, uint window_us, size_t window_bytes, u_int64_t checkpoint_bytes) :
+            path(path), window_us(window_us), window_bytes(window_bytes), checkpoint_bytes(checkpoint_bytes),
+            id(next_log_id++), fd(-1), mutex(), checkpoint_mutex(), work(), flushed_group(), flusher(), group(),
+            images(), filling(1), durable(0), commit_waiting(false), first_wait(), stopping(false), writing(false),
+            size(0), error(), recovered_from(), commits(0), flushes(0), bytes(0), checkpoints(0) {
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+/**
+ * Replay the log into the files it names, empty it, and start logging
+ * @throws WriteAheadLogError if the log cannot be opened
+ */
+void WriteAheadLog::open() {
+    if (fd >= 0)
+        return;
+    recover();
+    if (::truncate(path.c_str(), 0) != 0 && errno != ENOENT)
+        throw WriteAheadLogError("cannot empty " + path + ": " + std::strerror(errno));
+    start();
+}
+
+/**
+ * Write out the group being filled and stop logging
+ */
+void WriteAheadLog::close() {
+    if (fd < 0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work.notify_one();
+    flusher.join();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ::close(fd);
+        fd = -1;
+    }
+    flushed_group.notify_all();
+}
+
+/**
+ * Log a block's new image (its group's earlier image of the block, if any, is overwritten)
+ * @param file_name the HeapFile's name
+ * @param block_id the block
+ * @param image DbBlock::BLOCK_SZ bytes
+ */
+void WriteAheadLog::log_page(const std::string &file_name, BlockID block_id, const void *image) {
+    append(PAGE, file_name, block_id, image);
+}
+
+/**
+ * Log that a file was created, and wait for that to be durable
+ * (so no image logged for an earlier file by that name is ever replayed into it)
+ */
+void WriteAheadLog::log_create(const std::string &file_name) {
+    append(CREATE, file_name, 0, nullptr);
+    wait_durable();
+}
+
+/**
+ * Log that a file is being dropped, and wait for that to be durable
+ */
+void WriteAheadLog::log_drop(const std::string &file_name) {
+    append(DROP, file_name, 0, nullptr);
+    wait_durable();
+}
+
+/**
+ * Wait until everything this thread has logged is durable, then checkpoint if the log has grown past
+ * checkpoint_bytes (and no other thread is already checkpointing it)
+ * Must not be called while holding a block's latch, since the checkpoint writes back every dirty block.
+ * @throws WriteAheadLogError if the log could not be written or synced
+ */
+void WriteAheadLog::commit() {
+    if (!wait_durable())
+        return;
+    std::unique_lock<std::mutex> turn(checkpoint_mutex, std::try_to_lock);
+    if (turn.owns_lock())
+        take_checkpoint();
+}
+
+/**
+ * Drop every record logged before now from the log, once the blocks they hold are in their files
+ * Tables may stay open and in use; records logged while it runs are kept.
+ * @throws WriteAheadLogError if the log cannot be shortened
+ */
+void WriteAheadLog::checkpoint() {
+    std::lock_guard<std::mutex> turn(checkpoint_mutex);
+    take_checkpoint();
+}
+
+/**
+ * Wait until everything this thread has logged is durable
+ * @return true if the log has grown past checkpoint_bytes
+ * @throws WriteAheadLogError if the log could not be written or synced
+ */
+bool WriteAheadLog::wait_durable() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (last_record.log_id != id || last_record.group <= durable || fd < 0)
+        return fd >= 0 && size >= checkpoint_bytes;
+    commits++;
+    u_int64_t wanted = last_record.group;
+    if (wanted == filling && !commit_waiting) {
+        commit_waiting = true;
+        first_wait = std::chrono::steady_clock::now();
+        work.notify_one();
+    }
+    flushed_group.wait(lock, [&]() { return durable >= wanted || !error.empty() || fd < 0; });
+    if (!error.empty())
+        throw WriteAheadLogError(error);
+    return fd >= 0 && size >= checkpoint_bytes;
+}
+
+/**
+ * The checkpoint itself, run while holding checkpoint_mutex
+ * Any image logged before the log's end is noted was logged after its frame was marked dirty, so
+ * BufferPool::flush_logged() writes that block (or a later image of it) to its file.
+ */
+void WriteAheadLog::take_checkpoint() {
+    u_int64_t end;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        end = size;
+    }
+    BufferPool::flush_logged();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (fd < 0) {
+        if (::truncate(path.c_str(), 0) != 0 && errno != ENOENT)
+            throw WriteAheadLogError("cannot empty " + path + ": " + std::strerror(errno));
+        return;
+    }
+    flushed_group.wait(lock, [&]() { return !writing; });
+    cut(end);
+    checkpoints++;
+}
+
+/**
+ * Drop the first bytes of the log file, keeping the groups written after them
+ * Called holding the mutex with no group being written. If anything is left, it is copied to a new
+ * file that is synced and renamed over the log, so a crash leaves either the old log or the new one.
+ * @param offset where the first group to keep starts
+ * @throws WriteAheadLogError if the log cannot be shortened
+ */
+void WriteAheadLog::cut(u_int64_t offset) {
+    if (offset == size) {
+        if (::ftruncate(fd, 0) != 0 || ::fsync(fd) != 0)
+            throw WriteAheadLogError("cannot empty " + path + ": " + std::strerror(errno));
+        size = 0;
+        return;
+    }
+
+    std::string temp = path + ".new";
+    int from = ::open(path.c_str(), O_RDONLY);
+    int to = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    try {
+        if (from < 0 || to < 0)
+            throw WriteAheadLogError("cannot open " + temp + ": " + std::strerror(errno));
+        std::vector<char> buffer(1 << 16);
+        for (u_int64_t at = offset; at < size;) {
+            ssize_t n = ::pread(from, buffer.data(), (size_t) std::min((u_int64_t) buffer.size(), size - at), (off_t) at);
+            if (n <= 0)
+                throw WriteAheadLogError("cannot read " + path + ": " + std::strerror(errno));
+            write_all(to, buffer.data(), (size_t) n);
+            at += (u_int64_t) n;
+        }
+        if (::fdatasync(to) != 0 || ::rename(temp.c_str(), path.c_str()) != 0)
+            throw WriteAheadLogError("cannot replace " + path + ": " + std::strerror(errno));
+    } catch (...) {
+        if (from >= 0)
+            ::close(from);
+        if (to >= 0)
+            ::close(to);
+        ::unlink(temp.c_str());
+        throw;
+    }
+    ::close(from);
+    ::close(to);
+
+    // the rename has to be durable before anything is appended to the new file
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int dir_fd = ::open(dir.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+    ::close(fd);
+    fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0)
+        throw WriteAheadLogError("cannot open " + path + ": " + std::strerror(errno));
+    size -= offset;
+}
+
+/**
+ * Which of a file's blocks open() rewrote
+ * @param file_name the HeapFile's name
+ * @return the lowest block recovery wrote an image to (those after it may have been rewritten too), or 0 if none
+ */
+BlockID WriteAheadLog::recovered(const std::string &file_name) const {
+    auto found = recovered_from.find(file_name);
+    return found == recovered_from.end() ? 0 : found->second;
+}
+
+/**
+ * Open the log file for appending and start the flusher
+ */
+void WriteAheadLog::start() {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        throw WriteAheadLogError("cannot open " + path + ": " + std::strerror(errno));
+    stopping = false;
+    size = 0; // open() and checkpoint() only start on an empty log
+    error.clear();
+    flusher = std::thread(&WriteAheadLog::flush_loop, this);
+}
+
+/**
+ * The flusher: write out a group once a commit() has waited window_us for it or it reaches window_bytes
+ */
+void WriteAheadLog::flush_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work.wait(lock, [&]() { return stopping || commit_waiting || group.size() >= window_bytes; });
+        if (!stopping && group.size() < window_bytes)
+            work.wait_until(lock, first_wait + std::chrono::microseconds(window_us),
+                            [&]() { return stopping || group.size() >= window_bytes; });
+        if (group.empty()) {
+            commit_waiting = false;
+            if (stopping)
+                break;
+            continue;
+        }
+
+        // writers go on filling the next group while this one is written
+        std::vector<char> records;
+        records.swap(group);
+        images.clear();
+        u_int64_t number = filling++;
+        commit_waiting = false;
+        writing = true;
+        lock.unlock();
+        std::string failure;
+        try {
+            write_all(fd, records.data(), records.size());
+            if (::fdatasync(fd) != 0)
+                throw WriteAheadLogError("cannot sync " + path + ": " + std::strerror(errno));
+        } catch (WriteAheadLogError &e) {
+            failure = e.what();
+        }
+        lock.lock();
+        writing = false;
+        if (failure.empty()) {
+            durable = number;
+            flushes++;
+            bytes += records.size();
+            size += records.size();
+        } else {
+            error = failure;
+        }
+        flushed_group.notify_all();
+    }
+}
+
+/**
+ * Add a record to the group being filled
+ */
+void WriteAheadLog::append(RecordType type, const std::string &file_name, BlockID block_id, const void *image) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd < 0)
+        return;
+    size_t size = HEADER_SZ + file_name.size() + (type == PAGE ? DbBlock::BLOCK_SZ : 0);
+    size_t offset;
+    if (type == PAGE && images.count(std::make_pair(file_name, block_id)) > 0) {
+        offset = images[std::make_pair(file_name, block_id)];
+    } else {
+        if (type != PAGE)
+            forget(file_name);
+        offset = group.size();
+        group.resize(offset + size);
+        char *header = &group[offset];
+        u_int16_t name_size = (u_int16_t) file_name.size();
+        std::memcpy(header, &MAGIC, 4);
+        header[4] = (char) type;
+        std::memcpy(header + 5, &name_size, 2);
+        std::memcpy(header + 7, &block_id, 4);
+        std::memcpy(header + HEADER_SZ, file_name.data(), file_name.size());
+        if (type == PAGE)
+            images[std::make_pair(file_name, block_id)] = offset;
+    }
+    char *record = &group[offset];
+    if (type == PAGE)
+        std::memcpy(record + HEADER_SZ + file_name.size(), image, DbBlock::BLOCK_SZ);
+    u_int32_t sum = checksum(record, size);
+    std::memcpy(record + CHECKSUM_OFFSET, &sum, 4);
+    last_record = LastRecord{id, filling};
+    if (group.size() >= window_bytes)
+        work.notify_one();
+}
+
+/**
+ * Stop coalescing a file's blocks into the images already in the group (it is being created or dropped,
+ * so later images have to come after that record)
+ */
+void WriteAheadLog::forget(const std::string &file_name) {
+    auto first = images.lower_bound(std::make_pair(file_name, (BlockID) 0));
+    auto last = first;
+    while (last != images.end() && last->first.first == file_name)
+        last++;
+    images.erase(first, last);
+}
+
+/**
+ * Write the last image of each block in the log back to its file
+ * The log is read a record at a time: the first pass only notes where each block's last image is,
+ * and the second reads those images back.
+ */
+void WriteAheadLog::recover() {
+    std::ifstream in(path, std::ios::binary);
+
+    // where the last image of each block is, forgetting a file's images whenever it is created or dropped
+    std::map<std::string, std::map<BlockID, u_int64_t>> last_images;
+    std::vector<char> record(HEADER_SZ);
+    u_int64_t offset = 0;
+    while (in.read(record.data(), HEADER_SZ)) {
+        u_int32_t magic, sum;
+        u_int16_t name_size;
+        BlockID block_id;
+        std::memcpy(&magic, record.data(), 4);
+        std::memcpy(&name_size, record.data() + 5, 2);
+        std::memcpy(&block_id, record.data() + 7, 4);
+        std::memcpy(&sum, record.data() + CHECKSUM_OFFSET, 4);
+        RecordType type = (RecordType) record[4];
+        size_t record_size = HEADER_SZ + name_size + (type == PAGE ? DbBlock::BLOCK_SZ : 0);
+        if (magic != MAGIC)
+            break;
+        record.resize(record_size);
+        if (!in.read(record.data() + HEADER_SZ, record_size - HEADER_SZ) || checksum(record.data(), record_size) != sum)
+            break; // torn by a crash mid-write: nothing after it was committed
+        std::string file_name(record.data() + HEADER_SZ, name_size);
+        if (type == PAGE)
+            last_images[file_name][block_id] = offset + HEADER_SZ + name_size;
+        else
+            last_images.erase(file_name);
+        offset += record_size;
+    }
+    in.clear();
+
+    std::vector<char> buffer(DbBlock::BLOCK_SZ);
+    for (const auto &file_images : last_images) {
+        if (file_images.second.empty())
+            continue;
+        HeapFile file(file_images.first);
+        try {
+            file.open();
+        } catch (DbException &e) {
+            continue; // dropped without the drop reaching the log
+        }
+        for (const auto &image : file_images.second) {
+            while (file.get_last_block_id() < image.first)
+                file.allocate(buffer.data());
+            in.seekg((std::streamoff) image.second);
+            if (!in.read(buffer.data(), DbBlock::BLOCK_SZ))
+                throw WriteAheadLogError("cannot read " + path);
+            Dbt data(buffer.data(), DbBlock::BLOCK_SZ);
+            SlottedPage page(data, image.first);
+            file.put(&page);
+        }
+        file.close();
+        recovered_from[file_images.first] = file_images.second.begin()->first;
+    }
+}
+
+/**
+ * Write bytes to a file (the log, or the copy checkpoint() makes of it), however many write() calls it takes
+ * @param to the file descriptor
+ * @throws WriteAheadLogError if the write fails
+ */
+void WriteAheadLog::write_all(int to, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(to, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw WriteAheadLogError("cannot write " + path + ": " + std::strerror(errno));
+        }
+        data += written;
+        size -= (size_t) written;
+    }
+}
+
+bool test_wal() {
+    const char *home;
+    _DB_ENV->get_home(&home);
+    const std::string path = std::string(home) + "/_test_wal_cpp.log";
+    WriteAheadLog *saved = _DB_LOG;
+    bool ok = true;
+
+    // concurrent commits share flushes, and a block logged twice in a group is written once
+    WriteAheadLog *log = new WriteAheadLog(path, 2000);
+    log->open();
+    char image[DbBlock::BLOCK_SZ];
+    std::memset(image, 'x', sizeof(image));
+    std::vector<std::thread> writers;
+    for (BlockID writer = 1; writer <= 8; writer++) {
+        writers.push_back(std::thread([log, writer, &image]() {
+            for (int i = 0; i < 20; i++) {
+                log->log_page("_test_wal_cpp_gone", writer, image);
+                log->commit();
+            }
+        }));
+    }
+    for (std::thread &writer : writers)
+        writer.join();
+    if (log->get_commits() != 160 || log->get_flushes() >= log->get_commits()) {
+        std::cout << "wal did not group " << log->get_commits() << " commits (" << log->get_flushes()
+                  << " flushes)" << std::endl;
+        ok = false;
+    }
+    u_int64_t bytes = log->get_bytes();
+    log->log_page("_test_wal_cpp_gone", 1, image);
+    log->log_page("_test_wal_cpp_gone", 1, image);
+    log->commit();
+    if (log->get_bytes() - bytes != HEADER_SZ + std::strlen("_test_wal_cpp_gone") + DbBlock::BLOCK_SZ) {
+        std::cout << "wal did not coalesce a block logged twice" << std::endl;
+        ok = false;
+    }
+    log->checkpoint();
+
+    // committed inserts survive losing the buffer pool: recovery puts them back in the file
+    _DB_LOG = log;
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    {
+        HeapTable table("_test_wal_cpp", column_names, column_attributes);
+        table.create();
+        Row row(&table.get_column_names());
+        for (int32_t a = 0; a < 100; a++) {
+            row.set(0, a);
+            row.set(1, "row " + std::to_string(a));
+            table.insert(row);
+        }
+        log->commit();
+        table.get_buffer_pool().discard(); // the crash: none of the blocks reach the file
+        table.close();
+    }
+    delete log; // as if the process had died, without a checkpoint
+
+    log = new WriteAheadLog(path);
+    _DB_LOG = log;
+    log->open();
+    {
+        HeapTable table("_test_wal_cpp", column_names, column_attributes);
+        table.open();
+        Predicates where;
+        where.push_back(Predicate("a", Predicate::GE, Value(90)));
+        Handles *handles = table.select(where);
+        if (log->recovered("_test_wal_cpp") != 1 || table.count() != 100 || handles->size() != 10) {
+            std::cout << "wal did not recover committed inserts (" << table.count() << " rows)" << std::endl;
+            ok = false;
+        }
+        delete handles;
+        table.drop();
+    }
+    log->checkpoint();
+    delete log;
+
+    // with the table open, commits checkpoint the log once it passes checkpoint_bytes, so it stays
+    // short, yet what was committed since the last checkpoint is still recovered
+    const u_int64_t checkpoint_bytes = 8 * DbBlock::BLOCK_SZ;
+    log = new WriteAheadLog(path, WriteAheadLog::DEFAULT_WINDOW_US, WriteAheadLog::DEFAULT_WINDOW_BYTES,
+                            checkpoint_bytes);
+    _DB_LOG = log;
+    log->open();
+    {
+        HeapTable table("_test_wal_cpp", column_names, column_attributes);
+        table.create();
+        Row row(&table.get_column_names());
+        for (int32_t a = 0; a < 300; a++) {
+            row.set(0, a);
+            row.set(1, "row " + std::to_string(a));
+            table.insert(row);
+            log->commit();
+        }
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (log->get_checkpoints() == 0 || (u_int64_t) in.tellg() >= checkpoint_bytes) {
+            std::cout << "wal did not checkpoint while the table was open (" << log->get_checkpoints()
+                      << " checkpoints, " << in.tellg() << " bytes)" << std::endl;
+            ok = false;
+        }
+        table.get_buffer_pool().discard(); // the crash: only the blocks checkpoints wrote back are in the file
+        table.close();
+    }
+    delete log;
+
+    log = new WriteAheadLog(path);
+    _DB_LOG = log;
+    log->open();
+    {
+        HeapTable table("_test_wal_cpp", column_names, column_attributes);
+        table.open();
+        if (table.count() != 300) {
+            std::cout << "wal lost rows committed after a checkpoint (" << table.count() << " rows)" << std::endl;
+            ok = false;
+        }
+        table.drop();
+    }
+    log->checkpoint();
+    delete log;
+    _DB_LOG = saved;
+    ::unlink(path.c_str());
+    return ok;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file wal.h - Write-ahead log of page images with group commit.
+ * WriteAheadLog
+ *
+ * @see "Seattle University, CPSC4300, Spring 2023"
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "storage_engine.h"
+
+class WriteAheadLog;
+
+/**
+ * The log every HeapFile and BufferPool writes to, or nullptr to run without one (like _DB_ENV, set by main)
+ */
+extern WriteAheadLog *_DB_LOG;
+
+/**
+ * @class WriteAheadLogError - exception for when the log file cannot be read or written
+ */
+class WriteAheadLogError : public std::runtime_error {
+public:
+    explicit WriteAheadLogError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class WriteAheadLog - redo log of whole blocks, made durable in groups
+ *
+ *      Every time a buffer pool unpins a block it changed, the block's image is copied into the
+        group of records being filled; HeapFile creates, drops and appends are logged the same way.
+        (Files that can be rebuilt or thrown away after a crash, like spill files and free-space and
+        zone maps, are not logged.)
+        A change is durable once the thread that made it calls commit(), which waits for the group
+        holding the thread's last record to be written and fdatasync'ed. One flusher thread writes
+        a group when it has waited window_us since the first commit() asked for it, or as soon as it
+        holds window_bytes, so concurrent writers share one flush (and while a flush is running the
+        next group fills up behind it). A block changed again before its group is written just
+        overwrites its image there, so a group holds each block at most once.
+
+        Replaying images is idempotent, so open() recovers by writing the last logged image of
+        each block back to its file (skipping files dropped afterwards), then empties the log. It
+        reads the log a record at a time, keeping only where each block's last image is, so a long
+        log does not have to fit in memory. recovered() tells a HeapTable which of its blocks were
+        rewritten, so it can bring its free-space and zone maps (which are not logged) up to date.
+
+        checkpoint() keeps the log short while tables are open: it notes where the log ends, writes
+        back every logged buffer pool's dirty frames and syncs their files, then drops the log up to
+        the noted end (records logged meanwhile are kept). commit() runs one once the log has grown
+        past checkpoint_bytes, in the committing thread. Changes are never rolled back: a change no
+        commit() has returned for may or may not survive a crash.
+ */
+class WriteAheadLog {
+public:
+    static const uint DEFAULT_WINDOW_US = 1000;
+    static const size_t DEFAULT_WINDOW_BYTES = 1 << 20;
+    static const u_int64_t DEFAULT_CHECKPOINT_BYTES = 64 << 20;
+
+    /**
+     * @param path          the log file (created if it does not exist)
+     * @param window_us     how long the first commit() of a group waits for others to join it
+     * @param window_bytes  a group this big is written without waiting out the window
+     * @param checkpoint_bytes  a commit() that finds the log this big checkpoints it
+     */
+    WriteAheadLog(const std::string &path, uint window_us = DEFAULT_WINDOW_US,
+                  size_t window_bytes = DEFAULT_WINDOW_BYTES, u_int64_t checkpoint_bytes = DEFAULT_CHECKPOINT_BYTES);
+
+    virtual ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog &other) = delete;
+
+    WriteAheadLog(WriteAheadLog &&temp) = delete;
+
+    WriteAheadLog &operator=(const WriteAheadLog &other) = delete;
+
+    WriteAheadLog &operator=(WriteAheadLog &&temp) = delete;
+
+    virtual void open(void);
+
+    virtual void close(void);
+
+    virtual void log_page(const std::string &file_name, BlockID block_id, const void *image);
+
+    virtual void log_create(const std::string &file_name);
+
+    virtual void log_drop(const std::string &file_name);
+
+    virtual void commit(void);
+
+    virtual void checkpoint(void);
+
+    virtual BlockID recovered(const std::string &file_name) const;
+
+    virtual u_int64_t get_commits() { return commits; }
+
+    virtual u_int64_t get_flushes() { return flushes; }
+
+    virtual u_int64_t get_bytes() { return bytes; }
+
+    virtual u_int64_t get_checkpoints() { return checkpoints; }
+
+protected:
+    enum RecordType : u_int8_t {
+        PAGE = 1, CREATE = 2, DROP = 3
+    };
+
+    std::string path;
+    uint window_us;
+    size_t window_bytes;
+    u_int64_t checkpoint_bytes;
+    u_int64_t id;                                       // tells this log's groups from another's in a thread
+    int fd;                                             // -1 while closed
+    std::mutex mutex;
+    std::mutex checkpoint_mutex;                        // one checkpoint at a time
+    std::condition_variable work;                       // signalled when a group is wanted or the log closes
+    std::condition_variable flushed_group;              // signalled when a group is durable
+    std::thread flusher;
+    std::vector<char> group;                            // the records of the group being filled
+    std::map<std::pair<std::string, BlockID>, size_t> images;  // offset of each block's image in group
+    u_int64_t filling;                                  // number of the group being filled
+    u_int64_t durable;                                  // number of the last group written and synced
+    bool commit_waiting;                                // a commit() is waiting on the group being filled
+    std::chrono::steady_clock::time_point first_wait;   // when the first commit() of the group started waiting
+    bool stopping;
+    bool writing;                                       // the flusher is writing a group to fd
+    u_int64_t size;                                     // bytes of whole groups in the log file
+    std::string error;                                  // why the last write or sync failed, if it did
+    std::map<std::string, BlockID> recovered_from;      // lowest block replayed in each file
+    u_int64_t commits;
+    u_int64_t flushes;
+    u_int64_t bytes;
+    u_int64_t checkpoints;
+
+    virtual bool wait_durable(void);
+
+    virtual void take_checkpoint(void);
+
+    virtual void cut(u_int64_t offset);
+
+    virtual void flush_loop(void);
+
+    virtual void append(RecordType type, const std::string &file_name, BlockID block_id, const void *image);
+
+    virtual void forget(const std::string &file_name);
+
+    virtual void start(void);
+
+    virtual void recover(void);
+
+    virtual void write_all(int to, const char *data, size_t size);
+};
+
+bool test_wal();
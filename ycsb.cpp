@@ -0,0 +1,427 @@
+/**
+ * @file ycsb.cpp - YCSB-style workload driver for HeapTable.
+ *
+ * Usage: ./ycsb [--workload A|B|C|E] [--read P] [--update P] [--insert P] [--scan P] [--records N] [--ops N]
+ *               [--threads N,N,...] [--width N] [--scan-length N] [--theta T] [--frames N] [--env DIR]
+ *               [--log 0|1] [--log-window-us N] [--log-window-bytes N]
+ *
+ *      Loads --records rows (id INT, payload TEXT of --width bytes) into a fresh table, then runs
+        one timed phase of --ops operations for each client thread count in --threads. Each
+        operation is drawn with the given proportions: a read projects one row, an update rewrites
+        one row's payload, an insert adds a row and a scan projects the --scan-length rows from an
+        id onwards (a select on an id range, which the zone map narrows to the blocks holding it).
+        Reads, updates and scans pick ids with a scrambled zipfian distribution of parameter
+        --theta over the loaded rows, so a few rows are hot but they are spread over the table.
+        The workloads are YCSB's: A 50% read/50% update, B 95% read/5% update, C read only and
+        E 95% scan/5% insert; the proportion options override them. For each phase it reports the
+        throughput and the p50, p99 and p99.9 latency of each kind of operation. Every client draws
+        from its own fixed seed, so runs are repeatable.
+        With --log 1, each update and insert is committed to a write-ahead log before it counts as
+        done (concurrent clients' commits share flushes), and each
+        phase also reports the commits and the flushes they took; an insert-only workload over
+        growing --threads shows how group commit scales.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
+#include "heap_storage.h"
+#include "wal.h"
+
+DbEnv *_DB_ENV;
+
+static const u_int32_t SEED = 4300;
+
+enum OpType {
+    READ, UPDATE, INSERT, SCAN, N_OP_TYPES
+};
+
+static const char *OP_NAMES[N_OP_TYPES] = {"read", "update", "insert", "scan"};
+
+/**
+ * @class ZipfianGenerator - item numbers 0 to n - 1 with item i drawn in proportion to 1 / (i + 1)^theta
+ *
+ *      Gray et al., "Quickly Generating Billion-Record Synthetic Databases", SIGMOD 1994, as YCSB
+        does it. next() scrambles the item with a hash so the popular items are not all at the start
+        of the table.
+ */
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(u_int64_t n, double theta) : n(n), theta(theta), zetan(zeta(n, theta)),
+                                                  alpha(1.0 / (1.0 - theta)) {
+        eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+    }
+
+    /**
+     * Draw an item
+     * @param random the caller's random number generator
+     * @return an item number in [0, n)
+     */
+    u_int64_t next(std::mt19937_64 &random) const {
+        return fnv1a(rank(random)) % n;
+    }
+
+protected:
+    u_int64_t n;
+    double theta;
+    double zetan;
+    double alpha;
+    double eta;
+
+    u_int64_t rank(std::mt19937_64 &random) const {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+        double uz = u * zetan;
+        if (uz < 1.0)
+            return 0;
+        if (uz < 1.0 + std::pow(0.5, theta))
+            return 1;
+        return std::min(n - 1, (u_int64_t) (n * std::pow(eta * u - eta + 1.0, alpha)));
+    }
+
+    static double zeta(u_int64_t n, double theta) {
+        double sum = 0;
+        for (u_int64_t i = 1; i <= n; i++)
+            sum += 1.0 / std::pow((double) i, theta);
+        return sum;
+    }
+
+    static u_int64_t fnv1a(u_int64_t value) {
+        u_int64_t hash = 0xcbf29ce484222325ULL;
+        for (uint i = 0; i < sizeof(value); i++) {
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+};
+
+/**
+ * @class UserTable - the table the clients share, and the handle of each id's row
+ *
+ *      The clients call the HeapTable at the same time; it latches the blocks they touch, so
+        they only wait for each other on the same block. The handles are kept in a vector that
+        inserts grow, so looking one up takes a mutex (held only for the lookup).
+ */
+class UserTable {
+public:
+    UserTable(const Identifier &name, uint buffer_frames) : table(name, column_names(), column_attributes(),
+                                                                  buffer_frames), handles(), mutex() {}
+
+    UserTable(const UserTable &other) = delete;
+
+    UserTable(UserTable &&temp) = delete;
+
+    UserTable &operator=(const UserTable &other) = delete;
+
+    UserTable &operator=(UserTable &&temp) = delete;
+
+    /**
+     * Create the table, dropping any left by an earlier run, and insert ids 0 to n_records - 1
+     */
+    void load(u_int64_t n_records, uint width) {
+        const u_int64_t BATCH = 10000;
+        table.create_if_not_exists();
+        table.drop();
+        table.create();
+        std::string payload(width, 'x');
+        Rows rows;
+        for (u_int64_t first = 0; first < n_records; first += BATCH) {
+            u_int64_t n = std::min(BATCH, n_records - first);
+            rows.assign(n, Row(&table.get_column_names()));
+            for (u_int64_t i = 0; i < n; i++) {
+                rows[i].set(0, (int32_t) (first + i));
+                rows[i].set(1, payload);
+            }
+            Handles *batch = table.insert_batch(rows);
+            handles.insert(handles.end(), batch->begin(), batch->end());
+            delete batch;
+        }
+        table.get_buffer_pool().flush();
+    }
+
+    void read(int32_t id, Row &row) {
+        table.project(handle(id), row);
+    }
+
+    void update(int32_t id, Row &row) {
+        table.update(handle(id), row);
+    }
+
+    void insert(Row &row) {
+        int32_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            id = (int32_t) handles.size();
+            handles.push_back(Handle(0, 0)); // filled in below; reads only pick loaded ids
+        }
+        row.set(0, id);
+        Handle inserted = table.insert(row);
+        std::lock_guard<std::mutex> lock(mutex);
+        handles[id] = inserted;
+    }
+
+    /**
+     * Project the rows with ids first to first + length - 1
+     * @return how many there were
+     */
+    uint scan(int32_t first, uint length, Row &row) {
+        Predicates where;
+        where.push_back(Predicate("id", Predicate::GE, Value(first)));
+        where.push_back(Predicate("id", Predicate::LT, Value(first + (int32_t) length)));
+        Handles *found = table.select(where);
+        for (Handle handle : *found)
+            table.project(handle, row);
+        uint n = (uint) found->size();
+        delete found;
+        return n;
+    }
+
+    const ColumnNames &get_column_names() const { return table.get_column_names(); }
+
+    void drop() {
+        table.drop();
+    }
+
+protected:
+    HeapTable table;
+    Handles handles;    // handles[id]
+    std::mutex mutex;   // guards handles
+
+    Handle handle(int32_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return handles[id];
+    }
+
+    static ColumnNames column_names() {
+        ColumnNames names;
+        names.push_back("id");
+        names.push_back("payload");
+        return names;
+    }
+
+    static ColumnAttributes column_attributes() {
+        ColumnAttributes attributes;
+        attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+        attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+        return attributes;
+    }
+};
+
+/**
+ * @class Workload - what the clients of a phase do
+ */
+struct Workload {
+    double proportions[N_OP_TYPES];
+    u_int64_t n_records;    // loaded before the phases (the ids reads, updates and scans pick from)
+    u_int64_t n_ops;        // per phase, shared out among the clients
+    uint width;
+    uint scan_length;
+    double theta;
+};
+
+/**
+ * Run one client's share of a phase
+ * @param table the shared table
+ * @param workload what to do
+ * @param zipfian the distribution of ids
+ * @param client which client this is (picks its seed)
+ * @param n_ops how many operations it runs
+ * @param latencies each operation's latency in nanoseconds, by OpType
+ */
+static void run_client(UserTable &table, const Workload &workload, const ZipfianGenerator &zipfian, uint client,
+                       u_int64_t n_ops, std::vector<std::vector<u_int64_t>> &latencies) {
+    std::mt19937_64 random(SEED + client);
+    std::discrete_distribution<int> choose(workload.proportions, workload.proportions + N_OP_TYPES);
+    Row row(&table.get_column_names());
+    Row payload(&table.get_column_names());
+    payload.set(0, 0);
+    std::string text(workload.width, 'x');
+    latencies.assign(N_OP_TYPES, std::vector<u_int64_t>());
+    for (u_int64_t i = 0; i < n_ops; i++) {
+        OpType op = (OpType) choose(random);
+        int32_t id = (int32_t) zipfian.next(random);
+        if (op == UPDATE || op == INSERT) {
+            std::fill(text.begin(), text.end(), (char) ('a' + random() % 26));
+            payload.set(0, id);
+            payload.set(1, text);
+        }
+        auto start = std::chrono::steady_clock::now();
+        switch (op) {
+            case READ:
+                table.read(id, row);
+                break;
+            case UPDATE:
+                table.update(id, payload);
+                break;
+            case INSERT:
+                table.insert(payload);
+                break;
+            default:
+                table.scan(id, workload.scan_length, row);
+                break;
+        }
+        if ((op == UPDATE || op == INSERT) && _DB_LOG != nullptr)
+            _DB_LOG->commit();
+        latencies[op].push_back((u_int64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+}
+
+/**
+ * A percentile of sorted latencies
+ * @return the latency, in microseconds
+ */
+static double percentile(const std::vector<u_int64_t> &sorted, double fraction) {
+    if (sorted.empty())
+        return 0;
+    size_t rank = (size_t) std::ceil(fraction * sorted.size());
+    return sorted[rank == 0 ? 0 : rank - 1] / 1000.0;
+}
+
+/**
+ * Run a timed phase with some number of clients and print its throughput and latencies
+ */
+static void run_phase(UserTable &table, const Workload &workload, const ZipfianGenerator &zipfian, uint n_threads) {
+    std::vector<std::vector<std::vector<u_int64_t>>> latencies(n_threads);
+    std::vector<std::thread> clients;
+    u_int64_t commits = _DB_LOG == nullptr ? 0 : _DB_LOG->get_commits();
+    u_int64_t flushes = _DB_LOG == nullptr ? 0 : _DB_LOG->get_flushes();
+    auto start = std::chrono::steady_clock::now();
+    for (uint client = 0; client < n_threads; client++) {
+        u_int64_t n_ops = workload.n_ops / n_threads + (client < workload.n_ops % n_threads ? 1 : 0);
+        clients.push_back(std::thread(run_client, std::ref(table), std::cref(workload), std::cref(zipfian), client,
+                                      n_ops, std::ref(latencies[client])));
+    }
+    for (std::thread &client : clients)
+        client.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "threads=" << n_threads << ": " << workload.n_ops << " ops in " << seconds << " s, "
+              << (u_int64_t) (workload.n_ops / seconds) << " ops/s" << std::endl;
+    if (_DB_LOG != nullptr) {
+        commits = _DB_LOG->get_commits() - commits;
+        flushes = _DB_LOG->get_flushes() - flushes;
+        std::cout << "  log: " << commits << " commits (" << (u_int64_t) (commits / seconds) << "/s) in " << flushes
+                  << " flushes" << std::endl;
+    }
+    std::cout << std::left << std::setw(10) << "  op" << std::right << std::setw(12) << "count"
+              << std::setw(12) << "ops/s" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us"
+              << std::setw(12) << "p99.9 us" << std::endl;
+    for (uint op = 0; op < N_OP_TYPES; op++) {
+        std::vector<u_int64_t> all;
+        for (const auto &client : latencies)
+            all.insert(all.end(), client[op].begin(), client[op].end());
+        if (all.empty())
+            continue;
+        std::sort(all.begin(), all.end());
+        std::cout << std::left << std::setw(10) << std::string("  ") + OP_NAMES[op] << std::right
+                  << std::setw(12) << all.size() << std::setw(12) << (u_int64_t) (all.size() / seconds)
+                  << std::fixed << std::setprecision(1) << std::setw(12) << percentile(all, 0.5)
+                  << std::setw(12) << percentile(all, 0.99) << std::setw(12) << percentile(all, 0.999)
+                  << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+}
+
+static void usage() {
+    std::cerr << "Usage: ./ycsb [--workload A|B|C|E] [--read P] [--update P] [--insert P] [--scan P] [--records N]"
+                 " [--ops N] [--threads N,N,...] [--width N] [--scan-length N] [--theta T] [--frames N]"
+                 " [--env DIR] [--log 0|1] [--log-window-us N] [--log-window-bytes N]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    Workload workload = {{0.95, 0.05, 0, 0}, 100000, 100000, 100, 100, 0.99};
+    std::vector<uint> thread_counts = {1, 2, 4, 8};
+    uint buffer_frames = BufferPool::DEFAULT_FRAMES;
+    std::string env_dir = "ycsb_env";
+    bool logged = false;
+    uint window_us = WriteAheadLog::DEFAULT_WINDOW_US;
+    size_t window_bytes = WriteAheadLog::DEFAULT_WINDOW_BYTES;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i], value = argv[i + 1];
+        if (option == "--workload") {
+            const double presets[][N_OP_TYPES] = {{0.5, 0.5, 0, 0}, {0.95, 0.05, 0, 0}, {1, 0, 0, 0}, {0, 0, 0.05, 0.95}};
+            const std::string names = "ABCE";
+            size_t preset = value.size() == 1 ? names.find(value[0]) : std::string::npos;
+            if (preset == std::string::npos) {
+                usage();
+                return 1;
+            }
+            std::copy(presets[preset], presets[preset] + N_OP_TYPES, workload.proportions);
+        } else if (option == "--read" || option == "--update" || option == "--insert" || option == "--scan") {
+            uint op = (uint) (std::find(OP_NAMES, OP_NAMES + N_OP_TYPES, option.substr(2)) - OP_NAMES);
+            workload.proportions[op] = std::atof(value.c_str());
+        } else if (option == "--records")
+            workload.n_records = std::strtoull(value.c_str(), nullptr, 10);
+        else if (option == "--ops")
+            workload.n_ops = std::strtoull(value.c_str(), nullptr, 10);
+        else if (option == "--threads") {
+            thread_counts.clear();
+            std::stringstream list(value);
+            std::string item;
+            while (std::getline(list, item, ','))
+                thread_counts.push_back((uint) std::max(1, std::atoi(item.c_str())));
+        } else if (option == "--width")
+            workload.width = (uint) std::atoi(value.c_str());
+        else if (option == "--scan-length")
+            workload.scan_length = (uint) std::max(1, std::atoi(value.c_str()));
+        else if (option == "--theta")
+            workload.theta = std::atof(value.c_str());
+        else if (option == "--frames")
+            buffer_frames = (uint) std::max(1, std::atoi(value.c_str()));
+        else if (option == "--env")
+            env_dir = value;
+        else if (option == "--log")
+            logged = std::atoi(value.c_str()) != 0;
+        else if (option == "--log-window-us")
+            window_us = (uint) std::atoi(value.c_str());
+        else if (option == "--log-window-bytes")
+            window_bytes = std::strtoull(value.c_str(), nullptr, 10);
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (workload.n_records < 2 || workload.theta <= 0 || workload.theta >= 1
+        || std::all_of(workload.proportions, workload.proportions + N_OP_TYPES, [](double p) { return p <= 0; })) {
+        std::cerr << "need at least 2 records, a theta between 0 and 1, and some operations" << std::endl;
+        return 1;
+    }
+
+    mkdir(env_dir.c_str(), 0755);
+    DbEnv env(0U);
+    env.set_message_stream(&std::cout);
+    env.set_error_stream(&std::cerr);
+    env.open(env_dir.c_str(), DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
+    _DB_ENV = &env;
+    WriteAheadLog log(env_dir + "/ycsb_wal.log", window_us, window_bytes);
+    if (logged) {
+        log.open();
+        _DB_LOG = &log;
+    }
+
+    UserTable table("_ycsb_usertable", buffer_frames);
+    auto start = std::chrono::steady_clock::now();
+    table.load(workload.n_records, workload.width);
+    if (_DB_LOG != nullptr)
+        _DB_LOG->commit();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "load: " << workload.n_records << " rows of " << workload.width << " bytes in " << seconds << " s, "
+              << (u_int64_t) (workload.n_records / seconds) << " rows/s" << std::endl;
+
+    ZipfianGenerator zipfian(workload.n_records, workload.theta);
+    for (uint n_threads : thread_counts)
+        run_phase(table, workload, zipfian, n_threads);
+    table.drop();
+    if (logged) {
+        log.checkpoint();
+        _DB_LOG = nullptr;
+    }
+    return 0;
+}